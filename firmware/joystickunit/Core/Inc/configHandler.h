@@ -13,6 +13,15 @@
 
 #define DIGITAL_PORT_NOT_USED   0xFF
 
+/* Channel configuration (changes the layout of the EEPROM!) */
+#define CONFIG_JOYSTICK_AXES    4     //Analog axes of the joystick-unit
+#define CONFIG_ANALOG_CHANNELS  4     //Analog channels of the remote-unit
+#define CONFIG_DIGITAL_CHANNELS 24    //Digital channels of the remote-unit
+#define CONFIG_SWITCHES         26    //Switches of the remote (sa, sb, ...)
+#define CONFIG_BUDDYBUTTONS     4     //Buddybuttons of the joystick-unit
+#define CONFIG_ANALOG_INPUTS    (CONFIG_JOYSTICK_AXES + CONFIG_ANALOG_CHANNELS)
+#define CONFIG_ANALOG_NAMES     "xyzwuvpq"  //Names of analog channels/axes
+
 typedef enum {
   ConfigHandler_OK,
   ConfigHandler_Error
@@ -35,11 +44,11 @@ typedef enum {
   analog_in_y = 1,
   analog_in_z = 2,
   analog_in_w = 3,
-  analog_in_rx = 4,
-  analog_in_ry = 5,
-  analog_in_rz = 6,
-  analog_in_rw = 7,
-  analog_in_none
+  analog_in_rx = CONFIG_JOYSTICK_AXES,
+  analog_in_ry = CONFIG_JOYSTICK_AXES + 1,
+  analog_in_rz = CONFIG_JOYSTICK_AXES + 2,
+  analog_in_rw = CONFIG_JOYSTICK_AXES + 3,
+  analog_in_none = CONFIG_ANALOG_INPUTS
 } Config_Analog_In_t;
 
 typedef enum {
@@ -64,18 +73,18 @@ typedef struct {
   uint8_t currentSlot;
 
   //Configuration of digital switches
-  uint8_t axis_channels[4];
-  SysConf_Switch_t switch_types[26];
-  uint8_t switch_ch1[26];
-  uint8_t switch_ch2[26];
+  uint8_t axis_channels[CONFIG_ANALOG_CHANNELS];
+  SysConf_Switch_t switch_types[CONFIG_SWITCHES];
+  uint8_t switch_ch1[CONFIG_SWITCHES];
+  uint8_t switch_ch2[CONFIG_SWITCHES];
 
   //Calibration data for analog channels
-  uint16_t aIn_midpoint[4];
-  uint16_t aIn_margin[4];
-  bool aIn_inverted[4];
-  uint16_t aOut_midpoint[4];
-  uint16_t aOut_margin[4];
-  bool aOut_inverted[4];
+  uint16_t aIn_midpoint[CONFIG_JOYSTICK_AXES];
+  uint16_t aIn_margin[CONFIG_JOYSTICK_AXES];
+  bool aIn_inverted[CONFIG_JOYSTICK_AXES];
+  uint16_t aOut_midpoint[CONFIG_ANALOG_CHANNELS];
+  uint16_t aOut_margin[CONFIG_ANALOG_CHANNELS];
+  bool aOut_inverted[CONFIG_ANALOG_CHANNELS];
 } SystemConfiguration_t;
 
 typedef struct {
@@ -85,9 +94,9 @@ typedef struct {
   //Configuration-type specific items
   union {
     struct {
-      uint8_t dOut[4];
-      Config_Analog_In_t aOut[4];
-      uint8_t aIn_deadzone[4];
+      uint8_t dOut[CONFIG_BUDDYBUTTONS];
+      Config_Analog_In_t aOut[CONFIG_ANALOG_CHANNELS];
+      uint8_t aIn_deadzone[CONFIG_JOYSTICK_AXES];
       uint8_t teacher_Port;
     } remoteunit;
   };
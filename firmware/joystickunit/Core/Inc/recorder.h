@@ -0,0 +1,71 @@
+/*******************************************************************************
+ * @file         : recorder.h
+ * @project      : 4D-Joystick, Joystick-Unit
+ * @author       : Fabian Baer
+ * @brief        : Records the control cycles of the remote-unit-task in a
+ *                 ring buffer and freezes a pre/post-window on a trigger.
+ ******************************************************************************/
+
+#ifndef __CORE_INC_RECORDER_H_
+#define __CORE_INC_RECORDER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <configHandler.h>
+
+#define RECORDER_DEPTH              256     //Number of records in ring buffer
+#define RECORDER_DEFAULT_PRE        192     //Default number of records before trigger
+#define RECORDER_DEFAULT_DELTA      1024    //Default threshold output jump (0 = disabled)
+#define RECORDER_MAGIC              0x31434552  //"REC1"
+
+#define RECORDER_FLAG_CONNECTED     0x01
+#define RECORDER_FLAG_TEACHER       0x02
+#define RECORDER_FLAG_CRC_ERROR     0x04
+#define RECORDER_FLAG_TIMEOUT       0x08
+#define RECORDER_FLAG_RETRY         0x10
+#define RECORDER_FLAG_TRIGGER       0x80
+
+typedef enum {
+  recorder_trigger_none = 0,
+  recorder_trigger_crcError,
+  recorder_trigger_teacherMode,
+  recorder_trigger_outputDelta,
+  recorder_trigger_manual
+} Recorder_Trigger_t;
+
+typedef enum {
+  recorder_state_armed = 0,
+  recorder_state_triggered,
+  recorder_state_frozen
+} Recorder_State_t;
+
+typedef struct {
+  uint32_t timestamp;     //ms since power-up
+  uint16_t joyRaw[CONFIG_JOYSTICK_AXES];    //Raw ADC values joystick
+  uint16_t remIn[CONFIG_ANALOG_CHANNELS];   //Analog values received from remote-unit
+  uint16_t out[CONFIG_ANALOG_CHANNELS];     //Calibrated analog values sent to remote-unit
+  uint32_t digitalOut;    //Digital channels sent to remote-unit (bit 0 = ch 0)
+  uint32_t digitalIn;     //Digital channels received from remote-unit
+  uint8_t flags;          //RECORDER_FLAG_x
+  uint8_t reserved[3];
+} Recorder_Record_t;
+
+typedef struct {
+  uint32_t magic;
+  uint16_t recordSize;
+  uint16_t recordCount;
+  uint16_t triggerIndex;  //Index of the trigger record within the dump
+  uint8_t triggerReason;  //Recorder_Trigger_t
+  uint8_t reserved;
+} Recorder_Header_t;
+
+void recorder_addRecord( Recorder_Record_t* pRecord );
+void recorder_trigger( void );
+void recorder_arm( uint32_t preTrigger, uint32_t deltaThreshold );
+Recorder_State_t recorder_getState( void );
+uint32_t recorder_getPreTrigger( void );
+uint32_t recorder_getDeltaThreshold( void );
+bool recorder_getCapture( Recorder_Header_t* pHeader );
+Recorder_Record_t* recorder_getRecord( uint32_t index );
+
+#endif /* __CORE_INC_RECORDER_H_ */
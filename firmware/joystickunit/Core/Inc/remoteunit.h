@@ -8,19 +8,108 @@
 #ifndef __CORE_INC_REMOTEUNIT_H_
 #define __CORE_INC_REMOTEUNIT_H_
 
+#include <stdbool.h>
 #include <cmsis_os.h>
+#include <configHandler.h>
+
+//Length of a frame to/from the remote-unit: Each analog value (12 bit) carries
+//four digital channels, remaining digital channels are packed in extra bytes.
+//The remote-unit adds the digital channels with edges since the last frame
+//(zero from the joystick-unit).
+//The joystick-unit appends the interest mask (inputs sampled by the remote-unit),
+//the remote-unit sends one statistic per frame in these bytes (id, 24 bit value).
+#define REMOTEUNIT_FRAME_DIGITAL_BYTES  ((CONFIG_DIGITAL_CHANNELS - 4*CONFIG_ANALOG_CHANNELS + 7) / 8)
+#define REMOTEUNIT_FRAME_EDGE_BYTES     ((CONFIG_DIGITAL_CHANNELS + 7) / 8)
+#define REMOTEUNIT_FRAME_INTEREST_BYTES ((CONFIG_ANALOG_CHANNELS + CONFIG_DIGITAL_CHANNELS + 7) / 8)
+#define REMOTEUNIT_FRAME_LENGTH         (2*CONFIG_ANALOG_CHANNELS + REMOTEUNIT_FRAME_DIGITAL_BYTES + \
+                                         REMOTEUNIT_FRAME_EDGE_BYTES + REMOTEUNIT_FRAME_INTEREST_BYTES + 1)
+
+//Interest mask: analog channels first, followed by the digital channels
+#define REMOTEUNIT_INTEREST_ANALOG(ch)  (1ULL << (ch))
+#define REMOTEUNIT_INTEREST_DIGITAL(ch) (1ULL << (CONFIG_ANALOG_CHANNELS + (ch)))
+#define REMOTEUNIT_INTEREST_ALL         (~0ULL >> (64 - CONFIG_ANALOG_CHANNELS - CONFIG_DIGITAL_CHANNELS))
 
 typedef struct {
-  uint32_t rem_x;
-  uint32_t rem_y;
-  uint32_t rem_z;
-  uint32_t rem_w;
-  uint32_t joy_x;
-  uint32_t joy_y;
-  uint32_t joy_z;
-  uint32_t joy_w;
+  uint32_t rem[CONFIG_ANALOG_CHANNELS];
+  uint32_t joy[CONFIG_JOYSTICK_AXES];
 } RemoteUnit_adcStates_t;
 
+typedef struct {
+  uint32_t framesOk;
+  uint32_t crcErrors;
+  uint32_t timeouts;
+  uint32_t retries;
+  uint32_t retriesRecovered;
+  uint32_t consecutiveLosses;
+  uint32_t maxConsecutiveLosses;
+  uint32_t uptime_ms;
+  bool linkUp;
+} RemoteUnit_linkStats_t;
+
+//Statistics of the remote-unit (must match the remote-unit)
+typedef enum {
+  remoteunit_stat_none = 0,
+  remoteunit_stat_cycleTime,
+  remoteunit_stat_inputsTime,
+  remoteunit_stat_linkTime,
+  remoteunit_stat_outputsTime,
+  remoteunit_stat_i2cTime,
+  remoteunit_stat_dacTime,
+  remoteunit_stat_linkErrors,
+  remoteunit_stat_i2cErrors,
+  remoteunit_stat_missedTicks,
+  remoteunit_stat_resetCause,
+  remoteunit_stat_failovers,
+  remoteunit_stat_failoverTime,
+  remoteunit_stat_recoveryTime,
+  remoteunit_stat_cpuLoad
+} RemoteUnit_stat_t;
+
+//Reset flags of the remote-unit (RCC_CSR bits 24-31)
+#define REMOTEUNIT_RESET_BOR        0x02
+#define REMOTEUNIT_RESET_PIN        0x04
+#define REMOTEUNIT_RESET_POR        0x08
+#define REMOTEUNIT_RESET_SOFTWARE   0x10
+#define REMOTEUNIT_RESET_WATCHDOG   0x60
+#define REMOTEUNIT_RESET_LOWPOWER   0x80
+
+typedef struct {
+  uint32_t cycleTime_us;    //Longest cycle (sample, exchange, output)
+  uint32_t inputsTime_us;   //Longest sampling of the inputs
+  uint32_t linkTime_us;     //Longest exchange with the joystick-unit
+  uint32_t outputsTime_us;  //Longest update of the outputs
+  uint32_t i2cTime_us;      //Longest I2C transfer (IO-expander)
+  uint32_t dacTime_us;      //Longest DAC burst
+  uint32_t linkErrors;      //Faulty frames received by the remote-unit
+  uint32_t i2cErrors;
+  uint32_t missedTicks;     //Missed scheduler ticks
+  uint32_t resetCause;      //REMOTEUNIT_RESET_x
+  uint32_t failovers;       //Fallbacks to passthrough without joystick-unit
+  uint32_t failoverTime_us; //Last valid frame until passthrough (last failover)
+  uint32_t recoveryTime_us; //First valid frame until outputs of joystick-unit (last recovery)
+  uint32_t cpuLoad;         //Per mille, time not spent sleeping
+  bool valid;               //Statistics were received
+} RemoteUnit_remoteStats_t;
+
+//Firmware update of the remote-unit (size of its application area)
+#define REMOTEUNIT_UPDATE_MAX_SIZE      (48*1024)
+
+typedef enum {
+  remoteunit_update_idle = 0,
+  remoteunit_update_begin,      //Remote-unit erases its staging area
+  remoteunit_update_data,       //Image is streamed
+  remoteunit_update_end,        //Remote-unit verifies the image
+  remoteunit_update_reboot,     //Remote-unit restarts, installs and runs the image
+  remoteunit_update_done,
+  remoteunit_update_failed
+} RemoteUnit_updateState_t;
+
+typedef enum {
+  remoteunit_link_down = 0,
+  remoteunit_link_degraded,
+  remoteunit_link_good
+} RemoteUnit_linkHealth_t;
+
 void remoteunit_init( void );
 void remoteunit_setBuddyButtonsMQ( osMessageQId msgQueue );
 void remoteunit_setupTask( osPriority priority );
@@ -28,5 +117,12 @@ void remoteunit_terminateTask( void );
 void remoteunit_reloadConfig( void );
 RemoteUnit_adcStates_t remoteunit_getADC( void );
 bool remoteunit_isTeachermodeActive( void );
+RemoteUnit_linkStats_t remoteunit_getLinkStats( void );
+RemoteUnit_linkHealth_t remoteunit_getLinkHealth( void );
+RemoteUnit_remoteStats_t remoteunit_getRemoteStats( void );
+bool remoteunit_startUpdate( uint32_t size );
+bool remoteunit_writeUpdate( uint8_t* pData, uint32_t len );
+bool remoteunit_finishUpdate( void );
+void remoteunit_abortUpdate( void );
 
 #endif /* __CORE_INC_REMOTEUNIT_H_ */
@@ -14,5 +14,6 @@ void ui_init( void );
 void ui_setRotaryEncoderMQ( osMessageQId msgQueue );
 void ui_setupTask( osPriority priority );
 void ui_updateDisplay( void );
+uint32_t ui_getDisplayUpdateTime( void );
 
 #endif /* __CORE_INC_USERINTERFACE_H_ */
@@ -12,6 +12,12 @@
 #include <cli_commands.h>
 #include <configHandler.h>
 #include <remoteunit.h>
+#include <recorder.h>
+#include <userinterface.h>
+
+
+/* Defines -------------------------------------------------------------------*/
+#define UPDATE_CHUNK_SIZE   64    //Bytes of the remote-unit image per line (hex encoded)
 
 
 /* Macros --------------------------------------------------------------------*/
@@ -53,6 +59,14 @@ static void cli_commands_remShow(CLI_Handle_t *hcli);
 static void cli_commands_remMap(CLI_Handle_t *hcli);
 static void cli_commands_backup(CLI_Handle_t *hcli);
 static void cli_commands_restore(CLI_Handle_t *hcli);
+static void cli_commands_recSetup(CLI_Handle_t *hcli);
+static void cli_commands_recTrigger(CLI_Handle_t *hcli);
+static void cli_commands_recDump(CLI_Handle_t *hcli);
+static void cli_commands_remUpdate(CLI_Handle_t *hcli);
+static bool cli_commands_parseHex(uint8_t* hex, uint8_t* data, uint32_t len);
+static void cli_commands_putAnalogList(CLI_Handle_t *hcli, uint8_t prefix, uint32_t count);
+static void cli_commands_putSwitchList(CLI_Handle_t *hcli);
+static inline uint32_t cli_commands_getAnalogId(uint8_t name);
 
 
 /* Variables -----------------------------------------------------------------*/
@@ -73,7 +87,11 @@ CLI_Function_t commands[] = {
     CLI_COMMAND("rem_map", cli_commands_remMap, "Maps a channel on the remote-unit"),
     CLI_COMMAND("backup", cli_commands_backup, "Creates a backup of all configurations"),
     CLI_COMMAND("restore", cli_commands_restore, "Restores a backup"),
-    CLI_COMMAND("info", cli_commands_info, "Show the system version"),
+    CLI_COMMAND("rec_setup", cli_commands_recSetup, "Configures and arms the cycle recorder"),
+    CLI_COMMAND("rec_trigger", cli_commands_recTrigger, "Triggers the cycle recorder"),
+    CLI_COMMAND("rec_dump", cli_commands_recDump, "Dumps the captured cycles (binary)"),
+    CLI_COMMAND("rem_update", cli_commands_remUpdate, "Updates the firmware of the remote-unit"),
+    CLI_COMMAND("info", cli_commands_info, "Show the system version and link statistics"),
     CLI_COMMAND("clear", cli_commands_clear, "Clears the CLI"),
     CLI_COMMAND("help", cli_commands_help, "Display all available commands"),
     //End of function list identifier, don't remove the next line.
@@ -416,8 +434,8 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  lower1 = adcStates.rem_x;
-  lower2 = adcStates.rem_y;
+  lower1 = adcStates.rem[analog_out_x];
+  lower2 = adcStates.rem[analog_out_y];
 
   cli_putStrLn(hcli, "Move left joystick on remote-unit to midpoint and press enter");
   if(cli_waitForEnter(hcli) != cli_input_OK) {
@@ -425,8 +443,8 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  mid1 = adcStates.rem_x;
-  mid2 = adcStates.rem_y;
+  mid1 = adcStates.rem[analog_out_x];
+  mid2 = adcStates.rem[analog_out_y];
 
   cli_putStrLn(hcli, "Move left joystick on remote-unit to upper-right corner and press enter");
   if(cli_waitForEnter(hcli) != cli_input_OK) {
@@ -434,8 +452,8 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  upper1 = adcStates.rem_x;
-  upper2 = adcStates.rem_y;
+  upper1 = adcStates.rem[analog_out_x];
+  upper2 = adcStates.rem[analog_out_y];
 
   cli_commands_calcCalib(lower1, upper1, &mid1, &inverted, &marg);
   if(configHandler_setAnalogOutCalibration(analog_out_x, mid1, marg, inverted) != ConfigHandler_OK) {
@@ -458,8 +476,8 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  lower1 = adcStates.rem_z;
-  lower2 = adcStates.rem_w;
+  lower1 = adcStates.rem[analog_out_z];
+  lower2 = adcStates.rem[analog_out_w];
 
   cli_putStrLn(hcli, "Move right joystick on remote-unit to midpoint and press enter");
   if(cli_waitForEnter(hcli) != cli_input_OK) {
@@ -467,8 +485,8 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  mid1 = adcStates.rem_z;
-  mid2 = adcStates.rem_w;
+  mid1 = adcStates.rem[analog_out_z];
+  mid2 = adcStates.rem[analog_out_w];
 
   cli_putStrLn(hcli, "Move right joystick on remote-unit to upper-right corner and press enter");
   if(cli_waitForEnter(hcli) != cli_input_OK) {
@@ -476,8 +494,8 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  upper1 = adcStates.rem_z;
-  upper2 = adcStates.rem_w;
+  upper1 = adcStates.rem[analog_out_z];
+  upper2 = adcStates.rem[analog_out_w];
 
   cli_commands_calcCalib(lower1, upper1, &mid1, &inverted, &marg);
   if(configHandler_setAnalogOutCalibration(analog_out_z, mid1, marg, inverted) != ConfigHandler_OK) {
@@ -500,8 +518,8 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  lower1 = adcStates.joy_x;
-  lower2 = adcStates.joy_y;
+  lower1 = adcStates.joy[analog_in_x];
+  lower2 = adcStates.joy[analog_in_y];
 
   cli_putStrLn(hcli, "Move joystick on joystick-unit to midpoint and press enter");
   if(cli_waitForEnter(hcli) != cli_input_OK) {
@@ -509,8 +527,8 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  mid1 = adcStates.joy_x;
-  mid2 = adcStates.joy_y;
+  mid1 = adcStates.joy[analog_in_x];
+  mid2 = adcStates.joy[analog_in_y];
 
   cli_putStrLn(hcli, "Move joystick on joystick-unit to upper-right corner and press enter");
   if(cli_waitForEnter(hcli) != cli_input_OK) {
@@ -518,8 +536,8 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  upper1 = adcStates.joy_x;
-  upper2 = adcStates.joy_y;
+  upper1 = adcStates.joy[analog_in_x];
+  upper2 = adcStates.joy[analog_in_y];
 
   cli_commands_calcCalib(lower1, upper1, &mid1, &inverted, &marg);
   if(configHandler_setAnalogInCalibration(analog_in_x, mid1, marg, inverted) != ConfigHandler_OK) {
@@ -541,7 +559,7 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  upper1 = adcStates.joy_z;
+  upper1 = adcStates.joy[analog_in_z];
 
   cli_putStrLn(hcli, "Bring 4d-joystick to front position and press enter");
   if(cli_waitForEnter(hcli) != cli_input_OK) {
@@ -549,7 +567,7 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  lower1 = adcStates.joy_z;
+  lower1 = adcStates.joy[analog_in_z];
 
   if(upper1 > lower1) {
     mid1 = (upper1 - lower1) / 2;
@@ -571,7 +589,7 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  mid1 = adcStates.joy_w;
+  mid1 = adcStates.joy[analog_in_w];
 
   cli_putStrLn(hcli, "Apply maximum pressure to the mouthpiece and press enter");
   if(cli_waitForEnter(hcli) != cli_input_OK) {
@@ -579,7 +597,7 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  upper1 = adcStates.joy_w;
+  upper1 = adcStates.joy[analog_in_w];
 
   cli_putStrLn(hcli, "Apply minimum pressure to the mouthpiece and press enter");
   if(cli_waitForEnter(hcli) != cli_input_OK) {
@@ -587,7 +605,7 @@ static void cli_commands_calibrate(CLI_Handle_t *hcli) {
     return;
   }
   adcStates = remoteunit_getADC();
-  lower1 = adcStates.joy_w;
+  lower1 = adcStates.joy[analog_in_w];
 
   cli_commands_calcCalib(lower1, upper1, &mid1, &inverted, &marg);
   if(configHandler_setAnalogInCalibration(analog_in_w, mid1, marg, inverted) != ConfigHandler_OK) {
@@ -614,8 +632,103 @@ static void cli_commands_calcCalib(uint16_t lower, uint16_t upper, uint16_t* mid
 
 
 static void cli_commands_info(CLI_Handle_t *hcli) {
+  RemoteUnit_linkStats_t linkStats = remoteunit_getLinkStats();
+  RemoteUnit_remoteStats_t remoteStats = remoteunit_getRemoteStats();
+
   cli_putStrLn(hcli, "4D-Joystick, Joystick-Unit");
   cli_putStrLn(hcli, "Firmware "FW_VERSION_STRING);
+  cli_putStr(hcli, "Full frame update [us]:  ");
+  cli_putNum(hcli, ui_getDisplayUpdateTime());
+  cli_newLine(hcli);
+
+  //Link statistics remote-unit
+  cli_newLine(hcli);
+  cli_putStrLn(hcli, "Remote-Unit link:");
+  cli_putStr(hcli, "  State:              ");
+  if(linkStats.linkUp) {
+    cli_putStrLn(hcli, "up");
+  } else {
+    cli_putStrLn(hcli, "down");
+  }
+  cli_putStr(hcli, "  Uptime [s]:         ");
+  cli_putNum(hcli, linkStats.uptime_ms / 1000);
+  cli_newLine(hcli);
+  cli_putStr(hcli, "  Valid frames:       ");
+  cli_putNum(hcli, linkStats.framesOk);
+  cli_newLine(hcli);
+  cli_putStr(hcli, "  CRC errors:         ");
+  cli_putNum(hcli, linkStats.crcErrors);
+  cli_newLine(hcli);
+  cli_putStr(hcli, "  Timeouts:           ");
+  cli_putNum(hcli, linkStats.timeouts);
+  cli_newLine(hcli);
+  cli_putStr(hcli, "  Retries:            ");
+  cli_putNum(hcli, linkStats.retries);
+  cli_putStr(hcli, " (");
+  cli_putNum(hcli, linkStats.retriesRecovered);
+  cli_putStrLn(hcli, " recovered)");
+  cli_putStr(hcli, "  Consecutive losses: ");
+  cli_putNum(hcli, linkStats.consecutiveLosses);
+  cli_putStr(hcli, " (max. ");
+  cli_putNum(hcli, linkStats.maxConsecutiveLosses);
+  cli_putStrLn(hcli, ")");
+
+  //Statistics reported by remote-unit
+  if(!remoteStats.valid) {
+    return;
+  }
+  cli_newLine(hcli);
+  cli_putStrLn(hcli, "Remote-Unit status:");
+  cli_putStr(hcli, "  Cycle time [us]:    ");
+  cli_putNum(hcli, remoteStats.cycleTime_us);
+  cli_putStr(hcli, " (in ");
+  cli_putNum(hcli, remoteStats.inputsTime_us);
+  cli_putStr(hcli, ", link ");
+  cli_putNum(hcli, remoteStats.linkTime_us);
+  cli_putStr(hcli, ", out ");
+  cli_putNum(hcli, remoteStats.outputsTime_us);
+  cli_putStrLn(hcli, ")");
+  cli_putStr(hcli, "  CPU load [%]:       ");
+  cli_putNum(hcli, remoteStats.cpuLoad / 10);
+  cli_putChar(hcli, '.');
+  cli_putNum(hcli, remoteStats.cpuLoad % 10);
+  cli_newLine(hcli);
+  cli_putStr(hcli, "  I2C transfer [us]:  ");
+  cli_putNum(hcli, remoteStats.i2cTime_us);
+  cli_newLine(hcli);
+  cli_putStr(hcli, "  DAC burst [us]:     ");
+  cli_putNum(hcli, remoteStats.dacTime_us);
+  cli_newLine(hcli);
+  cli_putStr(hcli, "  Link errors:        ");
+  cli_putNum(hcli, remoteStats.linkErrors);
+  cli_newLine(hcli);
+  cli_putStr(hcli, "  I2C errors:         ");
+  cli_putNum(hcli, remoteStats.i2cErrors);
+  cli_newLine(hcli);
+  cli_putStr(hcli, "  Missed ticks:       ");
+  cli_putNum(hcli, remoteStats.missedTicks);
+  cli_newLine(hcli);
+  cli_putStr(hcli, "  Failovers:          ");
+  cli_putNum(hcli, remoteStats.failovers);
+  cli_putStr(hcli, " (last ");
+  cli_putNum(hcli, remoteStats.failoverTime_us);
+  cli_putStr(hcli, "us, recovery ");
+  cli_putNum(hcli, remoteStats.recoveryTime_us);
+  cli_putStrLn(hcli, "us)");
+  cli_putStr(hcli, "  Last reset:         ");
+  if(remoteStats.resetCause & REMOTEUNIT_RESET_WATCHDOG) {
+    cli_putStrLn(hcli, "watchdog");
+  } else if(remoteStats.resetCause & REMOTEUNIT_RESET_LOWPOWER) {
+    cli_putStrLn(hcli, "low-power");
+  } else if(remoteStats.resetCause & REMOTEUNIT_RESET_SOFTWARE) {
+    cli_putStrLn(hcli, "software");
+  } else if(remoteStats.resetCause & (REMOTEUNIT_RESET_POR | REMOTEUNIT_RESET_BOR)) {
+    cli_putStrLn(hcli, "power-on");
+  } else if(remoteStats.resetCause & REMOTEUNIT_RESET_PIN) {
+    cli_putStrLn(hcli, "reset pin");
+  } else {
+    cli_putStrLn(hcli, "unknown");
+  }
 }
 
 
@@ -628,28 +741,17 @@ static void cli_commands_deadzone(CLI_Handle_t *hcli) {
 
   //Ask for analog channel
   cli_putStrLn(hcli, "Please select one of the following input channel:");
-  cli_putStrLn(hcli, "x, y, z, w");
+  cli_commands_putAnalogList(hcli, '\0', CONFIG_JOYSTICK_AXES);
+  cli_newLine(hcli);
   retval = cli_getInput(hcli, &buf, &len);
 
   switch(retval) {
     case cli_input_OK:
-      switch(buf) {
-        case 'x':
-          aIn = analog_in_x;
-          break;
-        case 'y':
-          aIn = analog_in_y;
-          break;
-        case 'z':
-          aIn = analog_in_z;
-          break;
-        case 'w':
-          aIn = analog_in_w;
-          break;
-        default:
-          cli_putStrLn(hcli, "Error: Invalid channel!");
-          cli_printAbort(hcli);
-          return;
+      aIn = cli_commands_getAnalogId(buf);
+      if(aIn >= CONFIG_JOYSTICK_AXES) {
+        cli_putStrLn(hcli, "Error: Invalid channel!");
+        cli_printAbort(hcli);
+        return;
       }
       break;
     case cli_input_empty:
@@ -734,7 +836,10 @@ static inline void cli_commands_mapAnalog(CLI_Handle_t *hcli) {
 
   //Ask for input channel
   cli_putStrLn(hcli, "Select one of the following input channels:");
-  cli_putStrLn(hcli, "x, y, z, w, rx, ry, rz, rw");
+  cli_commands_putAnalogList(hcli, '\0', CONFIG_JOYSTICK_AXES);
+  cli_putStr(hcli, ", ");
+  cli_commands_putAnalogList(hcli, 'r', CONFIG_ANALOG_CHANNELS);
+  cli_newLine(hcli);
   retval = cli_getInput(hcli, buf, &len);
 
   //Check input
@@ -749,49 +854,20 @@ static inline void cli_commands_mapAnalog(CLI_Handle_t *hcli) {
       return;
   }
 
-  if(len == 2 && buf[0] == 'r') {
-    switch(buf[1]) {
-      case 'x':
-        aIn = analog_in_rx;
-        break;
-      case 'y':
-        aIn = analog_in_ry;
-        break;
-      case 'z':
-        aIn = analog_in_rz;
-        break;
-      case 'w':
-        aIn = analog_in_rw;
-        break;
-      default:
-        cli_putStrLn(hcli, "Error: Invalid input!");
-        cli_printAbort(hcli);
-        return;
-    }
-  } else if(len == 1) {
-    switch(buf[0]) {
-      case 'x':
-        aIn = analog_in_x;
-        break;
-      case 'y':
-        aIn = analog_in_y;
-        break;
-      case 'z':
-        aIn = analog_in_z;
-        break;
-      case 'w':
-        aIn = analog_in_w;
-        break;
-      default:
-        cli_putStrLn(hcli, "Error: Invalid input!");
-        cli_printAbort(hcli);
-        return;
-    }
+  if(len == 2 && buf[0] == 'r' && cli_commands_getAnalogId(buf[1]) < CONFIG_ANALOG_CHANNELS) {
+    aIn = analog_in_rx + cli_commands_getAnalogId(buf[1]);
+  } else if(len == 1 && cli_commands_getAnalogId(buf[0]) < CONFIG_JOYSTICK_AXES) {
+    aIn = analog_in_x + cli_commands_getAnalogId(buf[0]);
+  } else {
+    cli_putStrLn(hcli, "Error: Invalid input!");
+    cli_printAbort(hcli);
+    return;
   }
 
   //Ask for output channel
   cli_putStrLn(hcli, "Select one of the following output channels:");
-  cli_putStrLn(hcli, "x, y, z, w");
+  cli_commands_putAnalogList(hcli, '\0', CONFIG_ANALOG_CHANNELS);
+  cli_newLine(hcli);
   len = 1;
   retval = cli_getInput(hcli, buf, &len);
 
@@ -807,23 +883,11 @@ static inline void cli_commands_mapAnalog(CLI_Handle_t *hcli) {
       return;
   }
 
-  switch(buf[0]) {
-    case 'x':
-      aOut = analog_out_x;
-      break;
-    case 'y':
-      aOut = analog_out_y;
-      break;
-    case 'z':
-      aOut = analog_out_z;
-      break;
-    case 'w':
-      aOut = analog_out_w;
-      break;
-    default:
-      cli_putStrLn(hcli, "Error: Invalid input!");
-      cli_printAbort(hcli);
-      return;
+  aOut = cli_commands_getAnalogId(buf[0]);
+  if(aOut >= CONFIG_ANALOG_CHANNELS) {
+    cli_putStrLn(hcli, "Error: Invalid input!");
+    cli_printAbort(hcli);
+    return;
   }
 
   //Change config
@@ -846,7 +910,14 @@ static inline void cli_commands_mapDigital(CLI_Handle_t *hcli) {
 
   //Ask for input channel
   cli_putStrLn(hcli, "Select one of the following input channels:");
-  cli_putStrLn(hcli, "b1, b2, b3, b4");
+  for(Config_BuddyButton_t btn = buddyButton1; btn < CONFIG_BUDDYBUTTONS; btn++) {
+    if(btn > buddyButton1) {
+      cli_putStr(hcli, ", ");
+    }
+    cli_putChar(hcli, 'b');
+    cli_putNum(hcli, btn+1);
+  }
+  cli_newLine(hcli);
   retval = cli_getInput(hcli, buf, &len);
 
   //Check input
@@ -861,23 +932,8 @@ static inline void cli_commands_mapDigital(CLI_Handle_t *hcli) {
       return;
   }
 
-  if(len == 2 && buf[0] == 'b' && buf[1] >= '1' && buf[1] <= '4') {
-    switch(buf[1]) {
-      case '1':
-        in = buddyButton1;
-        break;
-      case '2':
-        in = buddyButton2;
-        break;
-      case '3':
-        in = buddyButton3;
-        break;
-      case '4':
-        in = buddyButton4;
-        break;
-      default:
-        break;
-    }
+  if(len == 2 && buf[0] == 'b' && buf[1] >= '1' && buf[1] < '1' + CONFIG_BUDDYBUTTONS) {
+    in = buddyButton1 + (buf[1] - '1');
   } else {
     cli_putStrLn(hcli, "Error: Invalid input!");
     cli_printAbort(hcli);
@@ -886,7 +942,7 @@ static inline void cli_commands_mapDigital(CLI_Handle_t *hcli) {
 
   //Ask for output channel
   cli_putStrLn(hcli, "Select one of the following output channels:");
-  cli_putStrLn(hcli, "sa, sb, sc, ..., sy, sz");
+  cli_commands_putSwitchList(hcli);
   len = 2;
   retval = cli_getInput(hcli, buf, &len);
 
@@ -902,7 +958,7 @@ static inline void cli_commands_mapDigital(CLI_Handle_t *hcli) {
       return;
   }
 
-  if(len == 2 && buf[0] == 's' && buf[1] >= 'a' && buf[1] <= 'z') {
+  if(len == 2 && buf[0] == 's' && buf[1] >= 'a' && buf[1] < 'a' + CONFIG_SWITCHES) {
     out = buf[1] - 'a';
   } else {
     cli_putStrLn(hcli, "Error: Invalid input!");
@@ -929,7 +985,7 @@ static inline void cli_commands_mapTeacher(CLI_Handle_t *hcli) {
 
   //Ask for input channel
   cli_putStrLn(hcli, "Select one of the following input channels:");
-  cli_putStrLn(hcli, "sa, sb, sc, ..., sy, sz");
+  cli_commands_putSwitchList(hcli);
   retval = cli_getInput(hcli, buf, &len);
 
   //Check input
@@ -944,7 +1000,7 @@ static inline void cli_commands_mapTeacher(CLI_Handle_t *hcli) {
       return;
   }
 
-  if(len == 2 && buf[0] == 's' && buf[1] >= 'a' && buf[1] <= 'z') {
+  if(len == 2 && buf[0] == 's' && buf[1] >= 'a' && buf[1] < 'a' + CONFIG_SWITCHES) {
     in = buf[1] - 'a';
   } else {
     cli_putStrLn(hcli, "Error: Invalid input!");
@@ -966,78 +1022,30 @@ static inline void cli_commands_mapTeacher(CLI_Handle_t *hcli) {
 
 static void cli_commands_show(CLI_Handle_t *hcli) {
   Configuration_t* config = configHandler_getCurrentConfig();
+  Config_Analog_In_t in;
 
   //Analog channels
-  for(Config_Analog_Out_t out = analog_out_x; out <= analog_out_w; out++) {
+  for(Config_Analog_Out_t out = analog_out_x; out < CONFIG_ANALOG_CHANNELS; out++) {
+    in = config->remoteunit.aOut[out];
     cli_putChar(hcli, '(');
     cli_putNum(hcli, out+1);
     cli_putStr(hcli, ") ");
-    switch(config->remoteunit.aOut[out]) {
-      case analog_in_rx:
-        cli_putStr(hcli, "rx");
-        break;
-      case analog_in_x:
-        cli_putStr(hcli, "x ");
-        break;
-      case analog_in_ry:
-        cli_putStr(hcli, "ry");
-        break;
-      case analog_in_y:
-        cli_putStr(hcli, "y ");
-        break;
-      case analog_in_rz:
-        cli_putStr(hcli, "rz");
-        break;
-      case analog_in_z:
-        cli_putStr(hcli, "z ");
-        break;
-      case analog_in_rw:
-        cli_putStr(hcli, "rw");
-        break;
-      case analog_in_w:
-        cli_putStr(hcli, "w ");
-        break;
-      case analog_in_none:
-      default:
-        switch(out) {
-          case analog_out_x:
-            cli_putStr(hcli, "rx");
-            break;
-          case analog_out_y:
-            cli_putStr(hcli, "ry");
-            break;
-          case analog_out_z:
-            cli_putStr(hcli, "rz");
-            break;
-          case analog_out_w:
-            cli_putStr(hcli, "rw");
-            break;
-          default:
-            break;
-        }
-        break;
+    if(in < CONFIG_JOYSTICK_AXES) {
+      cli_putChar(hcli, CONFIG_ANALOG_NAMES[in]);
+      cli_putChar(hcli, ' ');
+    } else if(in < CONFIG_ANALOG_INPUTS) {
+      cli_putChar(hcli, 'r');
+      cli_putChar(hcli, CONFIG_ANALOG_NAMES[in-analog_in_rx]);
+    } else {
+      cli_putChar(hcli, 'r');
+      cli_putChar(hcli, CONFIG_ANALOG_NAMES[out]);
     }
     cli_putStr(hcli, " --> ");
-    switch(out) {
-      case analog_out_x:
-        cli_putStr(hcli, "x");
-        break;
-      case analog_out_y:
-        cli_putStr(hcli, "y");
-        break;
-      case analog_out_z:
-        cli_putStr(hcli, "z");
-        break;
-      case analog_out_w:
-        cli_putStr(hcli, "w");
-        break;
-      default:
-        break;
-    }
+    cli_putChar(hcli, CONFIG_ANALOG_NAMES[out]);
 
-    if(config->remoteunit.aOut[out] >= analog_in_x && config->remoteunit.aOut[out] <= analog_in_w) {
+    if(in < CONFIG_JOYSTICK_AXES) {
       cli_putStr(hcli, " [deadzone: ");
-      cli_putNum(hcli, config->remoteunit.aIn_deadzone[config->remoteunit.aOut[out]]);
+      cli_putNum(hcli, config->remoteunit.aIn_deadzone[in]);
       cli_putChar(hcli, ']');
     }
 
@@ -1045,9 +1053,9 @@ static void cli_commands_show(CLI_Handle_t *hcli) {
   }
 
   //Buddybuttons
-  for(Config_BuddyButton_t btn = buddyButton1; btn <= buddyButton4; btn++) {
+  for(Config_BuddyButton_t btn = buddyButton1; btn < CONFIG_BUDDYBUTTONS; btn++) {
     cli_putChar(hcli, '(');
-    cli_putNum(hcli, btn+5);
+    cli_putNum(hcli, CONFIG_ANALOG_CHANNELS+btn+1);
     cli_putStr(hcli, ") b");
     cli_putNum(hcli, btn+1);
     cli_putStr(hcli, " --> ");
@@ -1061,7 +1069,9 @@ static void cli_commands_show(CLI_Handle_t *hcli) {
   }
 
   //Teacher
-  cli_putStr(hcli, "(9) teacher --> ");
+  cli_putChar(hcli, '(');
+  cli_putNum(hcli, CONFIG_ANALOG_CHANNELS+CONFIG_BUDDYBUTTONS+1);
+  cli_putStr(hcli, ") teacher --> ");
   if(config->remoteunit.teacher_Port == DIGITAL_PORT_NOT_USED) {
     cli_putStrLn(hcli, "not used");
   } else {
@@ -1080,7 +1090,9 @@ static void cli_commands_unmap(CLI_Handle_t *hcli) {
   cli_newLine(hcli);
 
   //Ask the user for the channel to unmap
-  cli_putStrLn(hcli, "Select one of the channels to unmap (1-9):");
+  cli_putStr(hcli, "Select one of the channels to unmap (1-");
+  cli_putNum(hcli, CONFIG_ANALOG_CHANNELS+CONFIG_BUDDYBUTTONS+1);
+  cli_putStrLn(hcli, "):");
   retval = cli_getNum(hcli, &channel);
   switch(retval) {
     case cli_input_OK:
@@ -1094,17 +1106,17 @@ static void cli_commands_unmap(CLI_Handle_t *hcli) {
   }
 
   //Check input and unmap
-  if(channel > 0 && channel < 5) {
+  if(channel > 0 && channel <= CONFIG_ANALOG_CHANNELS) {
     if(configHandler_setAxis(analog_in_none, channel-1+analog_out_x) == ConfigHandler_OK) {
       cli_printSucess(hcli);
       return;
     }
-  } else if(channel > 4 && channel < 9) {
-    if(configHandler_setBuddyButton(buddyButton1+channel-5, DIGITAL_PORT_NOT_USED) == ConfigHandler_OK) {
+  } else if(channel > CONFIG_ANALOG_CHANNELS && channel <= CONFIG_ANALOG_CHANNELS+CONFIG_BUDDYBUTTONS) {
+    if(configHandler_setBuddyButton(buddyButton1+channel-CONFIG_ANALOG_CHANNELS-1, DIGITAL_PORT_NOT_USED) == ConfigHandler_OK) {
       cli_printSucess(hcli);
       return;
     }
-  } else if(channel == 9) {
+  } else if(channel == CONFIG_ANALOG_CHANNELS+CONFIG_BUDDYBUTTONS+1) {
     if(configHandler_setTeacherPort(DIGITAL_PORT_NOT_USED) == ConfigHandler_OK) {
       cli_printSucess(hcli);
       return;
@@ -1124,28 +1136,15 @@ static inline void cli_commands_remShow(CLI_Handle_t *hcli) {
   SystemConfiguration_t* sysConfig = configHandler_getSystemConfig();
 
   //Show analog channels
-  for(Config_Analog_Out_t i = analog_out_x; i<=analog_out_w; i++) {
-    switch(i) {
-      case analog_out_x:
-        cli_putChar(hcli, 'x');
-        break;
-      case analog_out_y:
-        cli_putChar(hcli, 'y');
-        break;
-      case analog_out_z:
-        cli_putChar(hcli, 'z');
-        break;
-      case analog_out_w:
-        cli_putChar(hcli, 'w');
-        break;
-    }
+  for(Config_Analog_Out_t i = analog_out_x; i<CONFIG_ANALOG_CHANNELS; i++) {
+    cli_putChar(hcli, CONFIG_ANALOG_NAMES[i]);
     cli_putStr(hcli, " -> A");
     cli_putNum(hcli, sysConfig->axis_channels[i]);
     cli_newLine(hcli);
   }
 
   //Show digital channels
-  for(uint32_t i = 0; i<26; i++) {
+  for(uint32_t i = 0; i<CONFIG_SWITCHES; i++) {
     cli_putChar(hcli, 's');
     cli_putChar(hcli, i+'a');
     cli_putStr(hcli, " -> ");
@@ -1201,7 +1200,9 @@ static void cli_commands_remMap(CLI_Handle_t *hcli) {
 
   //Ask for channel to map
   cli_putStrLn(hcli, "Select one of the following channels to map:");
-  cli_putStrLn(hcli, "x, y, z, w, sa, sb, sc, ..., sy, sz");
+  cli_commands_putAnalogList(hcli, '\0', CONFIG_ANALOG_CHANNELS);
+  cli_putStr(hcli, ", ");
+  cli_commands_putSwitchList(hcli);
   retval = cli_getInput(hcli, buf, &len);
 
   switch(retval) {
@@ -1218,32 +1219,22 @@ static void cli_commands_remMap(CLI_Handle_t *hcli) {
   //Check channel
   if(len == 1) {
     //Analog channel
-    switch(buf[0]) {
-      case 'x':
-        aOut = analog_out_x;
-        break;
-      case 'y':
-        aOut = analog_out_y;
-        break;
-      case 'z':
-        aOut = analog_out_z;
-        break;
-      case 'w':
-        aOut = analog_out_w;
-        break;
-      default:
-        cli_putStrLn(hcli, "Error: Invalid channel!");
-        cli_printAbort(hcli);
-        return;
+    aOut = cli_commands_getAnalogId(buf[0]);
+    if(aOut >= CONFIG_ANALOG_CHANNELS) {
+      cli_putStrLn(hcli, "Error: Invalid channel!");
+      cli_printAbort(hcli);
+      return;
     }
 
     //Ask for channel
-    cli_putStrLn(hcli, "Select channel (0-3):");
+    cli_putStr(hcli, "Select channel (0-");
+    cli_putNum(hcli, CONFIG_ANALOG_CHANNELS-1);
+    cli_putStrLn(hcli, "):");
 
     retval = cli_getNum(hcli, &ch1);
     switch(retval) {
       case cli_input_OK:
-        if(ch1 > 3) {
+        if(ch1 >= CONFIG_ANALOG_CHANNELS) {
           cli_putStrLn(hcli, "Error: Invalid channel!");
           cli_printAbort(hcli);
           return;
@@ -1265,7 +1256,7 @@ static void cli_commands_remMap(CLI_Handle_t *hcli) {
     cli_putStrLn(hcli, "Error!");
     cli_printAbort(hcli);
 
-  } else if (len == 2 && buf[0] == 's' && buf[1]>='a' && buf[1]<='z') {
+  } else if (len == 2 && buf[0] == 's' && buf[1]>='a' && buf[1]<'a'+CONFIG_SWITCHES) {
     //Digital channel
 
     //Ask for switch-type
@@ -1294,12 +1285,14 @@ static void cli_commands_remMap(CLI_Handle_t *hcli) {
 
     if(type > 1) {
       //Ask for ch1
-      cli_putStrLn(hcli, "Select ch1 (0-23):");
+      cli_putStr(hcli, "Select ch1 (0-");
+      cli_putNum(hcli, CONFIG_DIGITAL_CHANNELS-1);
+      cli_putStrLn(hcli, "):");
 
       retval = cli_getNum(hcli, &ch1);
       switch(retval) {
         case cli_input_OK:
-          if(ch1 > 23) {
+          if(ch1 >= CONFIG_DIGITAL_CHANNELS) {
             cli_putStrLn(hcli, "Error: Invalid channel!");
             cli_printAbort(hcli);
             return;
@@ -1316,12 +1309,14 @@ static void cli_commands_remMap(CLI_Handle_t *hcli) {
 
     if(type == 3) {
       //Ask for ch2
-      cli_putStrLn(hcli, "Select ch2 (0-23):");
+      cli_putStr(hcli, "Select ch2 (0-");
+      cli_putNum(hcli, CONFIG_DIGITAL_CHANNELS-1);
+      cli_putStrLn(hcli, "):");
 
       retval = cli_getNum(hcli, &ch2);
       switch(retval) {
         case cli_input_OK:
-          if(ch2 > 23) {
+          if(ch2 >= CONFIG_DIGITAL_CHANNELS) {
             cli_putStrLn(hcli, "Error: Invalid channel!");
             cli_printAbort(hcli);
             return;
@@ -1407,3 +1402,237 @@ static void cli_commands_restore(CLI_Handle_t *hcli) {
 
   NVIC_SystemReset();
 }
+
+static void cli_commands_recSetup(CLI_Handle_t *hcli) {
+  CLI_InputState_t retval;
+  uint32_t preTrigger, deltaThreshold;
+
+  //Show current configuration
+  cli_putStr(hcli, "Recorder: ");
+  switch(recorder_getState()) {
+    case recorder_state_armed:
+      cli_putStrLn(hcli, "armed");
+      break;
+    case recorder_state_triggered:
+      cli_putStrLn(hcli, "triggered");
+      break;
+    case recorder_state_frozen:
+    default:
+      cli_putStrLn(hcli, "capture available");
+      break;
+  }
+  cli_putStr(hcli, "Records before trigger: ");
+  cli_putNum(hcli, recorder_getPreTrigger());
+  cli_newLine(hcli);
+  cli_putStr(hcli, "Output jump threshold:  ");
+  cli_putNum(hcli, recorder_getDeltaThreshold());
+  cli_newLine(hcli);
+  cli_newLine(hcli);
+
+  //Ask for pre-trigger window
+  cli_putStr(hcli, "Enter number of records before trigger (0-");
+  cli_putNum(hcli, RECORDER_DEPTH-1);
+  cli_putStrLn(hcli, "):");
+  retval = cli_getNum(hcli, &preTrigger);
+  switch(retval) {
+    case cli_input_OK:
+      if(preTrigger >= RECORDER_DEPTH) {
+        cli_putStrLn(hcli, "Error: Invalid value!");
+        cli_printAbort(hcli);
+        return;
+      }
+      break;
+    case cli_input_empty:
+      cli_putStrLn(hcli, "Error: Nothing entered!");
+      cli_printAbort(hcli);
+      return;
+    default:
+      return;
+  }
+
+  //Ask for output jump threshold
+  cli_putStrLn(hcli, "Enter output jump threshold (0-4095, 0 = disabled):");
+  retval = cli_getNum(hcli, &deltaThreshold);
+  switch(retval) {
+    case cli_input_OK:
+      if(deltaThreshold > 4095) {
+        cli_putStrLn(hcli, "Error: Invalid value!");
+        cli_printAbort(hcli);
+        return;
+      }
+      break;
+    case cli_input_empty:
+      cli_putStrLn(hcli, "Error: Nothing entered!");
+      cli_printAbort(hcli);
+      return;
+    default:
+      return;
+  }
+
+  recorder_arm(preTrigger, deltaThreshold);
+  cli_printSucess(hcli);
+}
+
+static void cli_commands_recTrigger(CLI_Handle_t *hcli) {
+  if(recorder_getState() != recorder_state_armed) {
+    cli_putStrLn(hcli, "Error: Recorder is not armed!");
+    cli_printAbort(hcli);
+    return;
+  }
+
+  recorder_trigger();
+  cli_printSucess(hcli);
+}
+
+static void cli_commands_recDump(CLI_Handle_t *hcli) {
+  Recorder_Header_t header;
+
+  if(!recorder_getCapture(&header)) {
+    cli_putStrLn(hcli, "Error: No capture available!");
+    cli_printAbort(hcli);
+    return;
+  }
+
+  //Send header and records (one record per chunk)
+  cli_print(hcli, (uint8_t*)&header, sizeof(header));
+  osDelay(4);
+  cli_putChar(hcli, '\r');
+
+  for(uint32_t i = 0; i < header.recordCount; i++) {
+    cli_print(hcli, (uint8_t*)recorder_getRecord(i), sizeof(Recorder_Record_t));
+    osDelay(4);
+    cli_putChar(hcli, '\r');
+  }
+
+  cli_putChar(hcli, '\x06');  //ACK
+}
+
+static void cli_commands_remUpdate(CLI_Handle_t *hcli) {
+  CLI_InputState_t retval;
+  uint32_t size, chunk;
+  uint32_t received = 0;
+  uint8_t data[UPDATE_CHUNK_SIZE];
+
+  //Ask for image size
+  cli_putStr(hcli, "Enter image size in bytes (1-");
+  cli_putNum(hcli, REMOTEUNIT_UPDATE_MAX_SIZE);
+  cli_putStrLn(hcli, "):");
+  retval = cli_getNum(hcli, &size);
+  switch(retval) {
+    case cli_input_OK:
+      if(size == 0 || size > REMOTEUNIT_UPDATE_MAX_SIZE) {
+        cli_putStrLn(hcli, "Error: Invalid value!");
+        cli_printAbort(hcli);
+        return;
+      }
+      break;
+    case cli_input_empty:
+      cli_putStrLn(hcli, "Error: Nothing entered!");
+      cli_printAbort(hcli);
+      return;
+    default:
+      return;
+  }
+
+  if(!remoteunit_startUpdate(size)) {
+    cli_putStrLn(hcli, "Error: Remote-unit not connected!");
+    cli_printAbort(hcli);
+    return;
+  }
+  cli_putChar(hcli, '\x06');  //ACK
+
+  //Receive image (hex encoded, raw data must not contain '\r'), the remote-unit
+  //receives the data while the next chunk is transferred
+  while(received < size) {
+    chunk = (size - received < UPDATE_CHUNK_SIZE) ? (size - received) : UPDATE_CHUNK_SIZE;
+    hcli->flags = CLI_FLAG_RX_RAW;
+    hcli->rxLength = 0;
+    hcli->rxCursor = 0;
+
+    while(!(hcli->flags & CLI_FLAG_RX_RETURN)) {
+      if (hcli->flags & CLI_FLAG_RX_ABORT) {
+        hcli->flags = 0;
+        remoteunit_abortUpdate();
+        cli_newLine(hcli);
+        cli_printAbort(hcli);
+        return;
+      }
+      osDelay(1);
+    }
+
+    if(hcli->rxLength != 2*chunk || !cli_commands_parseHex(hcli->rxBuffer, data, chunk) ||
+        !remoteunit_writeUpdate(data, chunk)) {
+      hcli->flags = 0;
+      remoteunit_abortUpdate();
+      cli_putChar(hcli, '\x15');  //NACK
+      return;
+    }
+    received += chunk;
+    cli_putChar(hcli, '\x06');  //ACK
+  }
+  hcli->flags = 0;
+
+  //Wait until the remote-unit verified the image and restarted
+  if(!remoteunit_finishUpdate()) {
+    cli_putStrLn(hcli, "Error: Update failed!");
+    cli_printAbort(hcli);
+    return;
+  }
+  cli_printSucess(hcli);
+}
+
+static bool cli_commands_parseHex(uint8_t* hex, uint8_t* data, uint32_t len) {
+  uint8_t nibble;
+
+  for(uint32_t i = 0; i < 2*len; i++) {
+    if(hex[i] >= '0' && hex[i] <= '9') {
+      nibble = hex[i] - '0';
+    } else if(hex[i] >= 'a' && hex[i] <= 'f') {
+      nibble = hex[i] - 'a' + 10;
+    } else if(hex[i] >= 'A' && hex[i] <= 'F') {
+      nibble = hex[i] - 'A' + 10;
+    } else {
+      return false;
+    }
+    data[i/2] = (i % 2 == 0) ? (nibble << 4) : (data[i/2] | nibble);
+  }
+
+  return true;
+}
+
+static void cli_commands_putAnalogList(CLI_Handle_t *hcli, uint8_t prefix, uint32_t count) {
+  for(uint32_t i = 0; i < count; i++) {
+    if(i > 0) {
+      cli_putStr(hcli, ", ");
+    }
+    if(prefix != '\0') {
+      cli_putChar(hcli, prefix);
+    }
+    cli_putChar(hcli, CONFIG_ANALOG_NAMES[i]);
+  }
+}
+
+static void cli_commands_putSwitchList(CLI_Handle_t *hcli) {
+  for(uint32_t i = 0; i < CONFIG_SWITCHES; i++) {
+    if(CONFIG_SWITCHES > 6 && i == 3) {
+      cli_putStr(hcli, "..., ");
+      i = CONFIG_SWITCHES - 2;
+    }
+    cli_putChar(hcli, 's');
+    cli_putChar(hcli, 'a'+i);
+    if(i < CONFIG_SWITCHES-1) {
+      cli_putStr(hcli, ", ");
+    }
+  }
+  cli_newLine(hcli);
+}
+
+static inline uint32_t cli_commands_getAnalogId(uint8_t name) {
+  for(uint32_t i = 0; i < sizeof(CONFIG_ANALOG_NAMES)-1; i++) {
+    if(CONFIG_ANALOG_NAMES[i] == name) {
+      return i;
+    }
+  }
+
+  return sizeof(CONFIG_ANALOG_NAMES);
+}
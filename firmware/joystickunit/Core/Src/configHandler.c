@@ -35,6 +35,15 @@
 #define STORE_CONFIG_ITEM(slot, item)         eeprom_write(ADDR_CONFIG_ITEM(slot, item), (uint8_t*)&configurations[slot].item, MEMBER_SIZE(Configuration_t, item))
 
 
+/* Typedefs ------------------------------------------------------------------*/
+//Check if the configurations fit into their EEPROM pages and the channel names
+typedef uint8_t assertSysConfigSize[(sizeof(SystemConfiguration_t) <= 256)*2-1];
+typedef uint8_t assertConfigSize[(sizeof(Configuration_t) <= 256)*2-1];
+typedef uint8_t assertSwitchNames[(CONFIG_SWITCHES <= 26)*2-1];
+typedef uint8_t assertAnalogNames[(sizeof(CONFIG_ANALOG_NAMES)-1 >= CONFIG_ANALOG_CHANNELS &&
+    sizeof(CONFIG_ANALOG_NAMES)-1 >= CONFIG_JOYSTICK_AXES)*2-1];
+
+
 /* Prototypes ----------------------------------------------------------------*/
 static inline bool configHandler_isStorageInitalized( void );
 static inline void configHandler_writeConfigToStorage( uint32_t slot, Configuration_t* pConfig );
@@ -58,20 +67,17 @@ static SystemConfiguration_t sysConfig = {
         sysconf_momentary_2pos, sysconf_momentary_2pos, sysconf_momentary_2pos,
         sysconf_momentary_2pos, sysconf_momentary_2pos, sysconf_momentary_2pos,
         sysconf_momentary_2pos, sysconf_momentary_2pos, sysconf_momentary_2pos,
-        sysconf_momentary_2pos, sysconf_switch_none, sysconf_switch_none,
-        sysconf_switch_none, sysconf_switch_none, sysconf_switch_none,
-        sysconf_switch_none, sysconf_switch_none, sysconf_switch_none,
-        sysconf_switch_none},
+        sysconf_momentary_2pos, [17 ... CONFIG_SWITCHES-1] = sysconf_switch_none},
     .switch_ch1 = {14, 11, 10,  7, 16, 23,  5, 22, 13, 21, 20, 19, 18,  0,  1,  2,  3,
-        NC, NC, NC, NC, NC, NC, NC, NC, NC},
+        [17 ... CONFIG_SWITCHES-1] = NC},
     .switch_ch2 = {15, 12,  9,  6, 17, NC,  4, NC, NC, NC, NC, NC, NC, NC, NC, NC, NC,
-        NC, NC, NC, NC, NC, NC, NC, NC, NC},
-    .aIn_midpoint = {2047, 2047, 2047, 2047},
-    .aIn_margin = {2000, 2000, 2000, 2000},
-    .aIn_inverted = {false, false, false, false},
-    .aOut_midpoint = {2047, 2047, 2047, 2047},
-    .aOut_margin = {2000, 2000, 2000, 2000},
-    .aOut_inverted = {false, false, false, false}
+        [17 ... CONFIG_SWITCHES-1] = NC},
+    .aIn_midpoint = {[0 ... CONFIG_JOYSTICK_AXES-1] = 2047},
+    .aIn_margin = {[0 ... CONFIG_JOYSTICK_AXES-1] = 2000},
+    .aIn_inverted = {[0 ... CONFIG_JOYSTICK_AXES-1] = false},
+    .aOut_midpoint = {[0 ... CONFIG_ANALOG_CHANNELS-1] = 2047},
+    .aOut_margin = {[0 ... CONFIG_ANALOG_CHANNELS-1] = 2000},
+    .aOut_inverted = {[0 ... CONFIG_ANALOG_CHANNELS-1] = false}
 };
 
 static const Configuration_t defaultRemoteunitConfig = {
@@ -79,18 +85,9 @@ static const Configuration_t defaultRemoteunitConfig = {
     .name = "Default",
     .remoteunit = {
       .teacher_Port = DIGITAL_PORT_NOT_USED,
-      .aOut[analog_out_x] = analog_in_none,
-      .aOut[analog_out_y] = analog_in_none,
-      .aOut[analog_out_z] = analog_in_none,
-      .aOut[analog_out_w] = analog_in_none,
-      .aIn_deadzone[analog_in_x] = 0,
-      .aIn_deadzone[analog_in_y] = 0,
-      .aIn_deadzone[analog_in_z] = 0,
-      .aIn_deadzone[analog_in_w] = 0,
-      .dOut[buddyButton1] = DIGITAL_PORT_NOT_USED,
-      .dOut[buddyButton2] = DIGITAL_PORT_NOT_USED,
-      .dOut[buddyButton3] = DIGITAL_PORT_NOT_USED,
-      .dOut[buddyButton4] = DIGITAL_PORT_NOT_USED
+      .aOut = {[0 ... CONFIG_ANALOG_CHANNELS-1] = analog_in_none},
+      .aIn_deadzone = {[0 ... CONFIG_JOYSTICK_AXES-1] = 0},
+      .dOut = {[0 ... CONFIG_BUDDYBUTTONS-1] = DIGITAL_PORT_NOT_USED}
     }
 };
 
@@ -562,13 +559,15 @@ ConfigHandler_Status_t configHandler_setBuddyButton( Config_BuddyButton_t in, ui
   osSemaphoreWait(hsem_config, osWaitForever);
 
   //Check if output is not already in use
-  if(IS_CURRENT_CONFIG_OF_TYPE(configType_remoteunit) &&
-      (out == DIGITAL_PORT_NOT_USED ||
-        (configurations[sysConfig.currentSlot].remoteunit.dOut[buddyButton1] != out &&
-        configurations[sysConfig.currentSlot].remoteunit.dOut[buddyButton2] != out &&
-        configurations[sysConfig.currentSlot].remoteunit.dOut[buddyButton3] != out &&
-        configurations[sysConfig.currentSlot].remoteunit.dOut[buddyButton4] != out )) &&
-      (out < 26 || out == DIGITAL_PORT_NOT_USED)) {
+  bool outInUse = false;
+  for(Config_BuddyButton_t btn = buddyButton1; btn < CONFIG_BUDDYBUTTONS; btn++) {
+    if(out != DIGITAL_PORT_NOT_USED && configurations[sysConfig.currentSlot].remoteunit.dOut[btn] == out) {
+      outInUse = true;
+    }
+  }
+
+  if(IS_CURRENT_CONFIG_OF_TYPE(configType_remoteunit) && !outInUse && in < CONFIG_BUDDYBUTTONS &&
+      (out < CONFIG_SWITCHES || out == DIGITAL_PORT_NOT_USED)) {
 
     configurations[sysConfig.currentSlot].remoteunit.dOut[in] = out;
     STORE_CONFIG_ITEM(sysConfig.currentSlot, remoteunit.dOut[in]);
@@ -593,7 +592,7 @@ ConfigHandler_Status_t configHandler_setTeacherPort( uint8_t dIn ) {
   osSemaphoreWait(hsem_config, osWaitForever);
 
   //Check if output is not already in use
-  if(IS_CURRENT_CONFIG_OF_TYPE(configType_remoteunit) && (dIn <  26|| dIn == DIGITAL_PORT_NOT_USED)) {
+  if(IS_CURRENT_CONFIG_OF_TYPE(configType_remoteunit) && (dIn < CONFIG_SWITCHES || dIn == DIGITAL_PORT_NOT_USED)) {
     configurations[sysConfig.currentSlot].remoteunit.teacher_Port = dIn;
     STORE_CONFIG_ITEM(sysConfig.currentSlot, remoteunit.teacher_Port);
 
@@ -619,7 +618,7 @@ ConfigHandler_Status_t configHandler_setAnalogInCalibration( Config_Analog_In_t
   osSemaphoreWait(hsem_config, osWaitForever);
 
   //Check if output is not already in use
-  if(midpoint > 500 && midpoint < 3594 && margin > 100 && margin < 2047 && aIn <= analog_in_w) {
+  if(midpoint > 500 && midpoint < 3594 && margin > 100 && margin < 2047 && aIn < CONFIG_JOYSTICK_AXES) {
     sysConfig.aIn_midpoint[aIn] = midpoint;
     STORE_SYSCONFIG_ITEM(aIn_midpoint[aIn]);
 
@@ -651,7 +650,7 @@ ConfigHandler_Status_t configHandler_setAnalogOutCalibration( Config_Analog_Out_
   osSemaphoreWait(hsem_config, osWaitForever);
 
   //Check if output is not already in use
-  if(midpoint > 500 && midpoint < 3594 && margin > 100 && margin < 2047 && aOut <= analog_out_w) {
+  if(midpoint > 500 && midpoint < 3594 && margin > 100 && margin < 2047 && aOut < CONFIG_ANALOG_CHANNELS) {
     sysConfig.aOut_midpoint[aOut] = midpoint;
     STORE_SYSCONFIG_ITEM(aOut_midpoint[aOut]);
 
@@ -684,19 +683,20 @@ ConfigHandler_Status_t configHandler_setGlobalSwitches( uint8_t id, SysConf_Swit
   osSemaphoreWait(hsem_config, osWaitForever);
 
   //Check if output is not already in use
-  if(id < 26 && (ch1 < 26 || ch1 == DIGITAL_PORT_NOT_USED) && (ch2 < 26 || ch2 == DIGITAL_PORT_NOT_USED)) {
+  if(id < CONFIG_SWITCHES && (ch1 < CONFIG_DIGITAL_CHANNELS || ch1 == DIGITAL_PORT_NOT_USED) &&
+      (ch2 < CONFIG_DIGITAL_CHANNELS || ch2 == DIGITAL_PORT_NOT_USED)) {
     sysConfig.switch_types[id] = type;
     STORE_SYSCONFIG_ITEM(switch_types[id]);
 
     sysConfig.switch_ch1[id] = ch1;
-    STORE_SYSCONFIG_ITEM(switch_types[ch1]);
+    STORE_SYSCONFIG_ITEM(switch_ch1[id]);
 
     if(type == sysconf_switch_3pos) {
       sysConfig.switch_ch2[id] = ch2;
     } else {
       sysConfig.switch_ch2[id] = DIGITAL_PORT_NOT_USED;
     }
-    STORE_SYSCONFIG_ITEM(switch_types[ch2]);
+    STORE_SYSCONFIG_ITEM(switch_ch2[id]);
 
     configHandler_forceConfigTaskToReloadConfig();
     retVal = ConfigHandler_OK;
@@ -719,7 +719,7 @@ ConfigHandler_Status_t configHandler_setGlobalAxis( Config_Analog_Out_t out, uin
   osSemaphoreWait(hsem_config, osWaitForever);
 
   //Check if output is not already in use
-  if(ch < 4 && ch >= 1 && out >= analog_out_x && out <= analog_out_w) {
+  if(ch < CONFIG_ANALOG_CHANNELS && out >= analog_out_x && out < CONFIG_ANALOG_CHANNELS) {
     sysConfig.axis_channels[out] = ch;
     STORE_SYSCONFIG_ITEM(axis_channels[out]);
 
@@ -0,0 +1,229 @@
+/*******************************************************************************
+ * @file         : recorder.c
+ * @project      : 4D-Joystick, Joystick-Unit
+ * @author       : Fabian Baer
+ * @brief        : Records the control cycles of the remote-unit-task in a
+ *                 ring buffer and freezes a pre/post-window on a trigger.
+ ******************************************************************************/
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <recorder.h>
+
+
+/* Typedefs ------------------------------------------------------------------*/
+//Check if the digital channels fit into the digital words of a record
+typedef uint8_t assertRecordDigitalSize[(CONFIG_DIGITAL_CHANNELS <= 32)*2-1];
+
+
+/* Prototypes ----------------------------------------------------------------*/
+static inline Recorder_Trigger_t recorder_checkTriggers( Recorder_Record_t* pRecord );
+
+
+/* Variables -----------------------------------------------------------------*/
+static Recorder_Record_t records[RECORDER_DEPTH];
+static uint32_t writeIndex = 0;
+static uint32_t recordCount = 0;
+static uint32_t postRemaining = 0;
+static uint32_t triggerPosition = 0;
+static Recorder_Trigger_t triggerReason = recorder_trigger_none;
+static Recorder_State_t state = recorder_state_armed;
+static uint32_t preTrigger = RECORDER_DEFAULT_PRE;
+static uint32_t deltaThreshold = RECORDER_DEFAULT_DELTA;
+static uint32_t new_preTrigger = RECORDER_DEFAULT_PRE;
+static uint32_t new_deltaThreshold = RECORDER_DEFAULT_DELTA;
+static Recorder_Record_t lastRecord = {0};
+static bool lastRecordValid = false;
+static bool flag_arm = false;
+static bool flag_trigger = false;
+
+
+/* Code ----------------------------------------------------------------------*/
+
+/*******************************************************************************
+ * Adds a record of the current control cycle to the ring buffer and evaluates
+ * the triggers. Must only be called by the remote-unit-task.
+ *
+ * @param pRecord A pointer to the record of the current cycle.
+ * @return nothing
+ *******************************************************************************/
+void recorder_addRecord( Recorder_Record_t* pRecord ) {
+  Recorder_Trigger_t trigger;
+
+  //Handle flags
+  if(flag_arm) {
+    flag_arm = false;
+    preTrigger = new_preTrigger;
+    deltaThreshold = new_deltaThreshold;
+    recordCount = 0;
+    writeIndex = 0;
+    triggerReason = recorder_trigger_none;
+    lastRecordValid = false;
+    state = recorder_state_armed;
+  }
+
+  if(state == recorder_state_frozen) {
+    flag_trigger = false;
+    return;
+  }
+
+  //Check triggers (only once per capture)
+  trigger = recorder_checkTriggers(pRecord);
+  if(state == recorder_state_armed && trigger != recorder_trigger_none) {
+    pRecord->flags |= RECORDER_FLAG_TRIGGER;
+    triggerReason = trigger;
+    postRemaining = RECORDER_DEPTH - preTrigger;
+    state = recorder_state_triggered;
+  }
+
+  //Store record
+  records[writeIndex] = *pRecord;
+  if(pRecord->flags & RECORDER_FLAG_TRIGGER) {
+    triggerPosition = writeIndex;
+  }
+  writeIndex = (writeIndex + 1) % RECORDER_DEPTH;
+  if(recordCount < RECORDER_DEPTH) {
+    recordCount++;
+  }
+
+  //Freeze after post-trigger-window
+  if(state == recorder_state_triggered) {
+    postRemaining--;
+    if(postRemaining == 0) {
+      state = recorder_state_frozen;
+    }
+  }
+}
+
+
+/*******************************************************************************
+ * Triggers a capture manually. The trigger is evaluated with the next record.
+ *
+ * @return nothing
+ *******************************************************************************/
+void recorder_trigger( void ) {
+  flag_trigger = true;
+}
+
+
+/*******************************************************************************
+ * (Re-)Arms the recorder with a new configuration. The previous capture is
+ * discarded with the next record.
+ *
+ * @param preTrigger Number of records before the trigger (< RECORDER_DEPTH)
+ * @param deltaThreshold Output jump which triggers a capture (0 = disabled)
+ * @return nothing
+ *******************************************************************************/
+void recorder_arm( uint32_t preTrigger, uint32_t deltaThreshold ) {
+  if(preTrigger >= RECORDER_DEPTH) {
+    preTrigger = RECORDER_DEPTH - 1;
+  }
+
+  new_preTrigger = preTrigger;
+  new_deltaThreshold = deltaThreshold;
+  flag_arm = true;
+}
+
+
+/*******************************************************************************
+ * Returns the current state of the recorder.
+ *
+ * @return recorder state
+ *******************************************************************************/
+Recorder_State_t recorder_getState( void ) {
+  return state;
+}
+
+
+/*******************************************************************************
+ * Returns the configured number of records before the trigger.
+ *
+ * @return pre-trigger records
+ *******************************************************************************/
+uint32_t recorder_getPreTrigger( void ) {
+  return preTrigger;
+}
+
+
+/*******************************************************************************
+ * Returns the configured threshold for output jumps.
+ *
+ * @return threshold (0 = disabled)
+ *******************************************************************************/
+uint32_t recorder_getDeltaThreshold( void ) {
+  return deltaThreshold;
+}
+
+
+/*******************************************************************************
+ * Provides the header of the frozen capture.
+ *
+ * @param pHeader A pointer to the header, which will be filled.
+ * @return true if a frozen capture is available
+ *******************************************************************************/
+bool recorder_getCapture( Recorder_Header_t* pHeader ) {
+  uint32_t oldest;
+
+  if(state != recorder_state_frozen || flag_arm) {
+    return false;
+  }
+
+  oldest = (writeIndex + RECORDER_DEPTH - recordCount) % RECORDER_DEPTH;
+
+  pHeader->magic = RECORDER_MAGIC;
+  pHeader->recordSize = sizeof(Recorder_Record_t);
+  pHeader->recordCount = recordCount;
+  pHeader->triggerIndex = (triggerPosition + RECORDER_DEPTH - oldest) % RECORDER_DEPTH;
+  pHeader->triggerReason = triggerReason;
+  pHeader->reserved = 0;
+
+  return true;
+}
+
+
+/*******************************************************************************
+ * Returns a record of the frozen capture (index 0 is the oldest record).
+ *
+ * @param index The index within the capture.
+ * @return A pointer to the record.
+ *******************************************************************************/
+Recorder_Record_t* recorder_getRecord( uint32_t index ) {
+  uint32_t oldest = (writeIndex + RECORDER_DEPTH - recordCount) % RECORDER_DEPTH;
+  return &records[(oldest + index) % RECORDER_DEPTH];
+}
+
+
+/*******************************************************************************
+ * Checks if the current record fulfills one of the trigger conditions.
+ *
+ * @param pRecord A pointer to the record of the current cycle.
+ * @return the trigger reason (recorder_trigger_none if not triggered)
+ *******************************************************************************/
+static inline Recorder_Trigger_t recorder_checkTriggers( Recorder_Record_t* pRecord ) {
+  Recorder_Trigger_t trigger = recorder_trigger_none;
+  int32_t delta;
+
+  if(flag_trigger) {
+    flag_trigger = false;
+    trigger = recorder_trigger_manual;
+  } else if(pRecord->flags & RECORDER_FLAG_CRC_ERROR) {
+    trigger = recorder_trigger_crcError;
+  } else if(lastRecordValid &&
+      ((pRecord->flags ^ lastRecord.flags) & RECORDER_FLAG_TEACHER)) {
+    trigger = recorder_trigger_teacherMode;
+  } else if(lastRecordValid && deltaThreshold > 0) {
+    for(uint32_t i = 0; i < CONFIG_ANALOG_CHANNELS; i++) {
+      delta = (int32_t)pRecord->out[i] - (int32_t)lastRecord.out[i];
+      if(delta < 0) delta = -delta;
+      if((uint32_t)delta > deltaThreshold) {
+        trigger = recorder_trigger_outputDelta;
+        break;
+      }
+    }
+  }
+
+  lastRecord = *pRecord;
+  lastRecordValid = true;
+
+  return trigger;
+}
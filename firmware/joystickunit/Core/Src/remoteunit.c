@@ -15,15 +15,46 @@
 #include <configHandler.h>
 #include <buttons.h>
 #include <adc.h>
+#include <recorder.h>
 
 
 /* Defines -------------------------------------------------------------------*/
 #define CRC_START_VALUE         0xA5
+#define LINK_MAX_RETRIES        1       //Retransmissions after a CRC-failure (delayed, LINK_RETRY_DELAY)
+#define LINK_RETRY_DELAY        2       //ms, at least one link job (1ms) of the remote-unit to re-arm
+                                        //(osDelay(1) waits only till the next tick, 0..1ms)
+#define LINK_DOWN_THRESHOLD     25      //Consecutive lost frames until link is down
+#define LINK_HEALTH_WINDOW      1000    //ms, window for link health evaluation
+#define INTEREST_SETTLE_FRAMES  3       //Frames until the answer was sampled with a new interest mask
+                                        //(answer to frame k is preloaded with the mask of frame k-2)
+
+//Firmware update of the remote-unit (frame layout must match the remote-unit)
+#define CRC_UPDATE_START        0x5A    //Start value of the CRC of update frames
+#define UPDATE_CMD_STATUS       0x00    //No data, only requests the status
+#define UPDATE_CMD_BEGIN        0x01    //Data: image size (32 bit)
+#define UPDATE_CMD_DATA         0x02    //Data: UPDATE_BLOCK_SIZE bytes of the image
+#define UPDATE_CMD_END          0x03    //Data: CRC-32 of the image
+#define UPDATE_CMD_REBOOT       0x04    //Reset to install the image
+#define UPDATE_STATUS_IDLE      0
+#define UPDATE_STATUS_RECEIVING 1
+#define UPDATE_STATUS_DONE      2
+#define UPDATE_STATUS_ERROR     3
+#define UPDATE_POS_DATA         4
+#define UPDATE_POS_MARKER       (REMOTEUNIT_FRAME_LENGTH - 2)
+#define UPDATE_MARKER           0x55
+#define UPDATE_BLOCK_SIZE       8       //Bytes of the image per frame
+#define UPDATE_WINDOW_SIZE      1024    //Bytes buffered between CLI and link (multiple of UPDATE_BLOCK_SIZE)
+#define UPDATE_MAX_INFLIGHT     2       //Unacknowledged blocks until resend (acknowledge lags one frame)
+#define UPDATE_FRAME_DELAY      2       //ms between frames (remote-unit handles one frame per ms)
+#define UPDATE_TIMEOUT          5000    //ms without progress until the update fails
+#define UPDATE_RESTART_FRAMES   10      //Consecutive lost frames, which indicate the restart of the remote-unit
+#define CRC32_POLYNOMIAL        0xEDB88320  //IEEE 802.3, reflected
 
 
 /* Macros --------------------------------------------------------------------*/
-#define ADD_GPIO_BIT(gpioval, bitnum)   (((gpioval == GPIO_PIN_SET) ? 1 : 0) << bitnum)
+#define ADD_GPIO_BIT(gpioval, bitnum)   (((gpioval == GPIO_PIN_SET) ? 1U : 0U) << bitnum)
 #define EXTRACT_GPIO_VAL(data, bitnum)  ((data & (1<<bitnum)) ? GPIO_PIN_SET : GPIO_PIN_RESET)
+#define ADD_PULSE_BIT(pulses, ch, bitnum) ((((pulses) >> (ch)) & 1U) << (bitnum))
 
 
 /* Typedefs ------------------------------------------------------------------*/
@@ -32,48 +63,90 @@ typedef struct {
   bool teacherPort_sw3Pos;
   uint8_t teacherPort_ch1;
   uint8_t teacherPort_ch2;
-  uint8_t axis_config[4];
-  SysConf_Switch_t bb_config[4];
-  uint8_t bb_ch1[4];
-  uint8_t bb_ch2[4];
+  uint8_t axis_config[CONFIG_ANALOG_CHANNELS];
+  SysConf_Switch_t bb_config[CONFIG_BUDDYBUTTONS];
+  uint8_t bb_ch1[CONFIG_BUDDYBUTTONS];
+  uint8_t bb_ch2[CONFIG_BUDDYBUTTONS];
 
   //Analog
-  Config_Analog_In_t aOut[4];
-  int32_t k_num[4];
-  int32_t k_den[4];
-  int32_t d_low[4];
-  int32_t d_high[4];
-  int32_t threas_low[4];
-  int32_t threas_high[4];
-  int32_t middpoint_in[4];
-  int32_t middpoint[4];
-  bool inInverted[4];
-  bool outInverted[4];
+  Config_Analog_In_t aOut[CONFIG_ANALOG_CHANNELS];
+  int32_t k_num[CONFIG_ANALOG_CHANNELS];
+  int32_t k_den[CONFIG_ANALOG_CHANNELS];
+  int32_t d_low[CONFIG_ANALOG_CHANNELS];
+  int32_t d_high[CONFIG_ANALOG_CHANNELS];
+  int32_t threas_low[CONFIG_ANALOG_CHANNELS];
+  int32_t threas_high[CONFIG_ANALOG_CHANNELS];
+  int32_t middpoint_in[CONFIG_ANALOG_CHANNELS];
+  int32_t middpoint[CONFIG_ANALOG_CHANNELS];
+  bool inInverted[CONFIG_ANALOG_CHANNELS];
+  bool outInverted[CONFIG_ANALOG_CHANNELS];
+
+  //Execution plan (only stages used by the slot are executed)
+  uint32_t plan_adcMask;
+  uint32_t plan_numCalibrated;
+  Config_Analog_Out_t plan_calibrated[CONFIG_ANALOG_CHANNELS];
+  uint32_t plan_numRemapped;
+  Config_Analog_Out_t plan_remapped[CONFIG_ANALOG_CHANNELS];
+  uint32_t plan_numBuddyButtons;
+  Config_BuddyButton_t plan_buddyButtons[CONFIG_BUDDYBUTTONS];
+  uint64_t plan_interest;
 } RemUnit_Config_t;
 
 typedef struct {
-  uint32_t analog[4];
-  GPIO_PinState digital[24];
+  uint32_t analog[CONFIG_ANALOG_CHANNELS];
+  GPIO_PinState digital[CONFIG_DIGITAL_CHANNELS];
+  uint32_t digitalIn;       //Levels received from the remote-unit (bit = channel)
+  uint32_t digitalPulses;   //Inputs pressed and released between two frames (bit = channel)
 } RemUnit_IOStates_t;
 
+//Check if the digital channels fill the high nibbles of the analog values
+typedef uint8_t assertFrameLayout[(CONFIG_DIGITAL_CHANNELS >= 4*CONFIG_ANALOG_CHANNELS)*2-1];
+
+//Check if all channels fit into the interest mask (uint64_t)
+typedef uint8_t assertInterestSize[(CONFIG_ANALOG_CHANNELS + CONFIG_DIGITAL_CHANNELS >= 1 &&
+                                    CONFIG_ANALOG_CHANNELS + CONFIG_DIGITAL_CHANNELS <= 64)*2-1];
+
+//Check if a statistic of the remote-unit (id and 24 bit value) fits into the interest bytes
+typedef uint8_t assertRemoteStatSize[(REMOTEUNIT_FRAME_INTEREST_BYTES >= 4)*2-1];
+
+//Check if a block of a firmware update fits into a frame and the window holds whole blocks
+typedef uint8_t assertUpdateBlock[(UPDATE_POS_DATA + UPDATE_BLOCK_SIZE <= UPDATE_POS_MARKER)*2-1];
+typedef uint8_t assertUpdateWindow[(UPDATE_WINDOW_SIZE % UPDATE_BLOCK_SIZE == 0)*2-1];
+
 typedef enum {
   bbState_off = 0,
   bbState_on_1 = 1,
   bbState_on_2 = 2
 } BuddyButton_State_t;
 
+typedef enum {
+  remUnit_frame_ok = 0,
+  remUnit_frame_crcError,
+  remUnit_frame_timeout
+} RemUnit_FrameState_t;
+
 
 /* Prototypes ----------------------------------------------------------------*/
 static void remUnit_task( void const *argument );
 static void remUnit_loadConfig( RemUnit_Config_t* pConfig );
-static inline void remUnit_getAxis( RemUnit_Config_t *pConfig, RemUnit_IOStates_t *pStates );
+static inline void remUnit_getAxis( RemUnit_Config_t *pConfig, RemUnit_IOStates_t *pStates,
+    uint32_t* pJoyRaw );
 static inline void remUnit_getBuddyButtons( RemUnit_Config_t *pConfig,
     RemUnit_IOStates_t *pIOStates, BuddyButton_State_t *pBuddyStates );
 static void remUnit_resetBuddyButtons( BuddyButton_State_t* pStates );
-static inline void remUnit_packData( RemUnit_IOStates_t* data, uint8_t* package );
+static inline void remUnit_packData( RemUnit_IOStates_t* data, uint64_t interest, uint8_t* package );
 static inline void remUnit_unpackData( RemUnit_IOStates_t* pData, uint8_t* pPackage );
-static uint8_t remUnit_calcCRC( uint8_t* pData, uint32_t len );
-static inline bool remUnit_checkCRC( uint8_t* data, uint32_t len );
+static inline void remUnit_storeRemoteStat( uint8_t id, uint32_t value );
+static uint8_t remUnit_calcCRC( uint8_t start, uint8_t* pData, uint32_t len );
+static inline bool remUnit_checkCRC( uint8_t start, uint8_t* data, uint32_t len );
+static RemUnit_FrameState_t remUnit_transferFrame( uint8_t* pTxData, uint8_t* pRxData, uint8_t crcStart );
+static inline bool remUnit_isUpdating( void );
+static void remUnit_updateStep( uint8_t* pTxData, uint8_t* pRxData );
+static inline void remUnit_packUpdate( uint8_t* pPackage );
+static uint32_t remUnit_crc32( uint32_t crc, const uint8_t* pData, uint32_t len );
+static void remUnit_updateLinkStats( bool frameReceived );
+static void remUnit_resetLink( void );
+static inline uint32_t remUnit_getDigitalWord( RemUnit_IOStates_t* pStates );
 
 
 /* Variables -----------------------------------------------------------------*/
@@ -86,12 +159,29 @@ static bool flag_terminateTask = false;
 static bool flag_sendADC = false;
 static bool flag_teacherMode = false;
 static RemoteUnit_adcStates_t adcStates = {0};
-static GPIO_TypeDef* const buddyButtons_ledPorts[4][2] = {
+static RemoteUnit_linkStats_t linkStats = {0};
+static RemoteUnit_remoteStats_t remoteStats = {0};
+static volatile RemoteUnit_updateState_t updateState = remoteunit_update_idle;
+static uint8_t updateBuffer[UPDATE_WINDOW_SIZE];
+static uint8_t updateSession = 0;
+static uint32_t updateSize = 0;
+static uint32_t updateCrc = 0;
+static volatile uint32_t updateReceived = 0;    //Bytes written by the CLI
+static volatile uint32_t updateAcked = 0;       //Bytes confirmed by the remote-unit
+static uint32_t updateSent = 0;                 //Next byte sent to the remote-unit
+static uint32_t updateLastProgress = 0;
+static uint32_t updateLostFrames = 0;           //Consecutive lost frames after the restart request
+static uint32_t linkUpSince = 0;
+static uint32_t linkWindowStart = 0;
+static uint32_t linkWindowErrors = 0;
+static uint32_t linkLastWindowErrors = 0;
+static uint32_t interestFullFrames = 0;
+static GPIO_TypeDef* const buddyButtons_ledPorts[CONFIG_BUDDYBUTTONS][2] = {
     {LED1_G_Port, LED1_R_Port},
     {LED2_G_Port, LED2_R_Port},
     {LED3_G_Port, LED3_R_Port},
     {LED4_G_Port, LED4_R_Port}};
-static uint16_t const buddyButtons_ledPins[4][2] = {
+static uint16_t const buddyButtons_ledPins[CONFIG_BUDDYBUTTONS][2] = {
     {LED1_G_Pin, LED1_R_Pin},
     {LED2_G_Pin, LED2_R_Pin},
     {LED3_G_Pin, LED3_R_Pin},
@@ -244,8 +334,12 @@ static void remUnit_task( void const *argument ) {
   (void)argument;
   RemUnit_Config_t currentConfig = {0};
   RemUnit_IOStates_t ioStates = {0};
-  BuddyButton_State_t buddyStates[4] = {0};
-  uint8_t rxData[10], txData[10];
+  BuddyButton_State_t buddyStates[CONFIG_BUDDYBUTTONS] = {0};
+  uint8_t rxData[REMOTEUNIT_FRAME_LENGTH], txData[REMOTEUNIT_FRAME_LENGTH];
+  RemUnit_FrameState_t frameState;
+  Recorder_Record_t record = {0};
+  uint32_t joyRaw[CONFIG_JOYSTICK_AXES] = {0};
+  uint64_t interest;
 
   //Enable Remote-Unit
   HAL_GPIO_WritePin(RJ12_CS_Port, RJ12_CS_Pin, GPIO_PIN_SET);
@@ -266,15 +360,23 @@ static void remUnit_task( void const *argument ) {
 
   //Setup structs
   remUnit_resetBuddyButtons(buddyStates);
-  for(uint32_t i = 0; i<24; i++) {
+  for(uint32_t i = 0; i<CONFIG_DIGITAL_CHANNELS; i++) {
     ioStates.digital[i] = GPIO_PIN_SET;
   }
-  for(uint32_t i = 0; i<4; i++) {
+  for(uint32_t i = 0; i<CONFIG_ANALOG_CHANNELS; i++) {
     ioStates.analog[i] = 0;
   }
 
   //Task loop
   while(1) {
+    //Firmware update of the remote-unit replaces the normal frames
+    if(remUnit_isUpdating()) {
+      remUnit_updateStep(txData, rxData);
+      system_watchdog_remoteunitTask++;
+      osDelay(UPDATE_FRAME_DELAY);
+      continue;
+    }
+
     //Check if teacher mode is enabled
     if(currentConfig.teacherPort_sw3Pos) {
       if(currentConfig.teacherPort_ch1 != DIGITAL_PORT_NOT_USED &&
@@ -294,24 +396,68 @@ static void remUnit_task( void const *argument ) {
       }
     }
 
-    //Get data if teacher mode is not enabled
+    //Get data if teacher mode is not enabled (skip stages unused by the slot)
     if(!flag_teacherMode) {
-      remUnit_getAxis(&currentConfig, &ioStates);
-      remUnit_getBuddyButtons(&currentConfig, &ioStates, buddyStates);
+      if(currentConfig.plan_adcMask != 0 || currentConfig.plan_numRemapped > 0 || flag_sendADC) {
+        remUnit_getAxis(&currentConfig, &ioStates, joyRaw);
+      }
+      if(currentConfig.plan_numBuddyButtons > 0) {
+        remUnit_getBuddyButtons(&currentConfig, &ioStates, buddyStates);
+      }
+    }
+
+    //Record outputs of this cycle
+    record.timestamp = HAL_GetTick();
+    record.flags = flag_teacherMode ? RECORDER_FLAG_TEACHER : 0;
+    for(uint32_t i = 0; i < CONFIG_JOYSTICK_AXES; i++) {
+      record.joyRaw[i] = joyRaw[i];
+    }
+    for(uint32_t i = 0; i < CONFIG_ANALOG_CHANNELS; i++) {
+      record.out[i] = ioStates.analog[i];
     }
+    record.digitalOut = remUnit_getDigitalWord(&ioStates);
 
-    //Communicate with remoteunit
+    //Communicate with remoteunit (retransmit after the next remote link job on CRC-failure)
     if(system_isRemoteConnected()) {
-      HAL_GPIO_WritePin(RJ12_CS_Port, RJ12_CS_Pin, GPIO_PIN_RESET);
-      remUnit_packData(&ioStates, txData);
-      if (HAL_SPI_TransmitReceive(&hspi1, txData, rxData, 10, 10) == HAL_ERROR) {
-        system_errorHandler();
+      record.flags |= RECORDER_FLAG_CONNECTED;
+      interest = flag_sendADC ? REMOTEUNIT_INTEREST_ALL : currentConfig.plan_interest;
+      remUnit_packData(&ioStates, interest, txData);
+      frameState = remUnit_transferFrame(txData, rxData, CRC_START_VALUE);
+
+      for(uint32_t retry = 0; retry < LINK_MAX_RETRIES && frameState == remUnit_frame_crcError; retry++) {
+        record.flags |= RECORDER_FLAG_CRC_ERROR | RECORDER_FLAG_RETRY;
+        osDelay(LINK_RETRY_DELAY);
+        linkStats.retries++;
+        frameState = remUnit_transferFrame(txData, rxData, CRC_START_VALUE);
+        if(frameState == remUnit_frame_ok) {
+          linkStats.retriesRecovered++;
+        }
       }
-      if(remUnit_checkCRC(rxData, 9)) {
+
+      if(frameState == remUnit_frame_ok) {
         remUnit_unpackData(&ioStates, rxData);
+        if(interest != REMOTEUNIT_INTEREST_ALL) {
+          interestFullFrames = 0;
+        } else if(interestFullFrames < INTEREST_SETTLE_FRAMES) {
+          interestFullFrames++;
+        }
+      } else if(frameState == remUnit_frame_crcError) {
+        record.flags |= RECORDER_FLAG_CRC_ERROR;
+      } else {
+        record.flags |= RECORDER_FLAG_TIMEOUT;
       }
-      HAL_GPIO_WritePin(RJ12_CS_Port, RJ12_CS_Pin, GPIO_PIN_SET);
+      remUnit_updateLinkStats(frameState == remUnit_frame_ok);
+    } else {
+      remUnit_resetLink();
+      interestFullFrames = 0;
+    }
+
+    //Record inputs of this cycle
+    for(uint32_t i = 0; i < CONFIG_ANALOG_CHANNELS; i++) {
+      record.remIn[i] = ioStates.analog[i];
     }
+    record.digitalIn = remUnit_getDigitalWord(&ioStates);
+    recorder_addRecord(&record);
 
     //Handle flags
     if(flag_reloadConfig) {
@@ -336,7 +482,8 @@ static void remUnit_task( void const *argument ) {
 /*******************************************************************************
  * Loads the current configuration in the "configHandler"-format and stores
  * necessary information in a given struct. This function is also responsible
- * for pre-calculation of the calibration data.
+ * for pre-calculation of the calibration data and derives the execution plan,
+ * so that the task loop skips all stages which are not used by the slot.
  *
  * @param pConfig A pointer to the local configuration struct
  * @return nothing
@@ -346,10 +493,9 @@ static void remUnit_loadConfig( RemUnit_Config_t* pConfig ) {
   SystemConfiguration_t* pSysConfig = configHandler_getSystemConfig();
 
   //Get analog axis
-  pConfig->axis_config[analog_out_x] = pSysConfig->axis_channels[analog_out_x];
-  pConfig->axis_config[analog_out_y] = pSysConfig->axis_channels[analog_out_y];
-  pConfig->axis_config[analog_out_z] = pSysConfig->axis_channels[analog_out_z];
-  pConfig->axis_config[analog_out_w] = pSysConfig->axis_channels[analog_out_w];
+  for(Config_Analog_Out_t out = analog_out_x; out < CONFIG_ANALOG_CHANNELS; out++) {
+    pConfig->axis_config[out] = pSysConfig->axis_channels[out];
+  }
 
   //Get teacher port
   if(pNewConfig->remoteunit.teacher_Port != DIGITAL_PORT_NOT_USED) {
@@ -363,11 +509,15 @@ static void remUnit_loadConfig( RemUnit_Config_t* pConfig ) {
   }
 
   //Get buddybuttons
-  for(Config_BuddyButton_t i = buddyButton1; i <= buddyButton4; i++) {
+  pConfig->plan_numBuddyButtons = 0;
+  for(Config_BuddyButton_t i = buddyButton1; i < CONFIG_BUDDYBUTTONS; i++) {
     if(pNewConfig->remoteunit.dOut[i] != DIGITAL_PORT_NOT_USED) {
       pConfig->bb_config[i] = pSysConfig->switch_types[pNewConfig->remoteunit.dOut[i]];
       pConfig->bb_ch1[i] = pSysConfig->switch_ch1[pNewConfig->remoteunit.dOut[i]];
       pConfig->bb_ch2[i] = pSysConfig->switch_ch2[pNewConfig->remoteunit.dOut[i]];
+      if(pConfig->bb_config[i] != sysconf_switch_none) {
+        pConfig->plan_buddyButtons[pConfig->plan_numBuddyButtons++] = i;
+      }
     } else {
       pConfig->bb_config[i] = sysconf_switch_none;
       pConfig->bb_ch1[i] = DIGITAL_PORT_NOT_USED;
@@ -376,11 +526,22 @@ static void remUnit_loadConfig( RemUnit_Config_t* pConfig ) {
   }
 
   //Analog configuration
-  for(Config_Analog_Out_t out = analog_out_x; out <= analog_out_w; out++) {
+  pConfig->plan_adcMask = 0;
+  pConfig->plan_numCalibrated = 0;
+  pConfig->plan_numRemapped = 0;
+  for(Config_Analog_Out_t out = analog_out_x; out < CONFIG_ANALOG_CHANNELS; out++) {
     pConfig->aOut[out] = pNewConfig->remoteunit.aOut[out];
 
+    //Outputs without an input keep the value of the remote-unit (nothing to do)
+    if(pConfig->aOut[out] < CONFIG_JOYSTICK_AXES) {
+      pConfig->plan_adcMask |= (1 << pConfig->aOut[out]);
+      pConfig->plan_calibrated[pConfig->plan_numCalibrated++] = out;
+    } else if(pConfig->aOut[out] < CONFIG_ANALOG_INPUTS) {
+      pConfig->plan_remapped[pConfig->plan_numRemapped++] = out;
+    }
+
     //Calculate calibration data if required (see "/docs/calibration_formula.pdf" for more informations)
-    if(pNewConfig->remoteunit.aOut[out] != analog_in_none && pNewConfig->remoteunit.aOut[out] < analog_in_rx) {
+    if(pNewConfig->remoteunit.aOut[out] != analog_in_none && pNewConfig->remoteunit.aOut[out] < CONFIG_JOYSTICK_AXES) {
       int32_t inMid = pSysConfig->aIn_midpoint[pNewConfig->remoteunit.aOut[out]];
       int32_t inMarg = pSysConfig->aIn_margin[pNewConfig->remoteunit.aOut[out]];
       int32_t inDead = (pNewConfig->remoteunit.aIn_deadzone[pNewConfig->remoteunit.aOut[out]])*2;
@@ -399,6 +560,28 @@ static void remUnit_loadConfig( RemUnit_Config_t* pConfig ) {
       pConfig->outInverted[out] = pSysConfig->aOut_inverted[out];
     }
   }
+
+  //Interest mask: The remote-unit only samples the inputs, which are not
+  //overwritten by the joystick-unit (all inputs are needed for teacher mode)
+  pConfig->plan_interest = REMOTEUNIT_INTEREST_ALL;
+  if(pConfig->teacherPort_ch1 == DIGITAL_PORT_NOT_USED) {
+    for(uint32_t i = 0; i < pConfig->plan_numCalibrated; i++) {
+      pConfig->plan_interest &= ~REMOTEUNIT_INTEREST_ANALOG(pConfig->axis_config[pConfig->plan_calibrated[i]]);
+    }
+    for(uint32_t i = 0; i < pConfig->plan_numBuddyButtons; i++) {
+      Config_BuddyButton_t btn = pConfig->plan_buddyButtons[i];
+      if(pConfig->bb_ch1[btn] != DIGITAL_PORT_NOT_USED) {
+        pConfig->plan_interest &= ~REMOTEUNIT_INTEREST_DIGITAL(pConfig->bb_ch1[btn]);
+      }
+      if(pConfig->bb_config[btn] == sysconf_switch_3pos && pConfig->bb_ch2[btn] != DIGITAL_PORT_NOT_USED) {
+        pConfig->plan_interest &= ~REMOTEUNIT_INTEREST_DIGITAL(pConfig->bb_ch2[btn]);
+      }
+    }
+    for(uint32_t i = 0; i < pConfig->plan_numRemapped; i++) {
+      Config_Analog_In_t in = pConfig->aOut[pConfig->plan_remapped[i]];
+      pConfig->plan_interest |= REMOTEUNIT_INTEREST_ANALOG(pConfig->axis_config[in-analog_in_rx]);
+    }
+  }
 }
 
 
@@ -440,96 +623,228 @@ bool remoteunit_isTeachermodeActive( void ) {
 }
 
 
+/*******************************************************************************
+ * Returns the statistics of the link to the remote-unit. The counters are
+ * accumulated since power-up, the uptime refers to the current link session.
+ *
+ * @return link statistics
+ *******************************************************************************/
+RemoteUnit_linkStats_t remoteunit_getLinkStats( void ) {
+  RemoteUnit_linkStats_t stats = linkStats;
+
+  stats.uptime_ms = stats.linkUp ? (HAL_GetTick() - linkUpSince) : 0;
+
+  return stats;
+}
+
+
+/*******************************************************************************
+ * Returns the health of the link to the remote-unit. The link is degraded if
+ * frames were lost during the last evaluation window.
+ *
+ * @return link health
+ *******************************************************************************/
+RemoteUnit_linkHealth_t remoteunit_getLinkHealth( void ) {
+  if(!linkStats.linkUp) {
+    return remoteunit_link_down;
+  }
+
+  if(linkStats.consecutiveLosses > 0 || linkLastWindowErrors > 0) {
+    return remoteunit_link_degraded;
+  }
+
+  return remoteunit_link_good;
+}
+
+
+/*******************************************************************************
+ * Returns the statistics reported by the remote-unit. Each statistic is updated
+ * once per rotation (about every 14 frames).
+ *
+ * @return remote-unit statistics
+ *******************************************************************************/
+RemoteUnit_remoteStats_t remoteunit_getRemoteStats( void ) {
+  return remoteStats;
+}
+
+
+/*******************************************************************************
+ * Starts a firmware update of the remote-unit. The image is passed with
+ * remoteunit_writeUpdate() and streamed by the remote-unit-task, the
+ * remote-unit acknowledges the blocks with the following frames. Lost frames
+ * are resent from the last acknowledged block.
+ *
+ * @param size Size of the image in bytes (max. REMOTEUNIT_UPDATE_MAX_SIZE)
+ * @return true if the update was started
+ *******************************************************************************/
+bool remoteunit_startUpdate( uint32_t size ) {
+  if(size == 0 || size > REMOTEUNIT_UPDATE_MAX_SIZE || remUnit_isUpdating() ||
+      !linkStats.linkUp) {
+    return false;
+  }
+
+  updateSession++;
+  updateSize = size;
+  updateCrc = 0;
+  updateReceived = 0;
+  updateAcked = 0;
+  updateSent = 0;
+  updateLastProgress = HAL_GetTick();
+  updateLostFrames = 0;
+  updateState = remoteunit_update_begin;
+
+  return true;
+}
+
+
+/*******************************************************************************
+ * Passes a part of the image to the running update. Blocks (osDelay(1)) while
+ * the window is full, i.e. until the remote-unit acknowledged older blocks.
+ *
+ * @param pData The data
+ * @param len Length of the data
+ * @return false if the update failed or the data exceeds the image size
+ *******************************************************************************/
+bool remoteunit_writeUpdate( uint8_t* pData, uint32_t len ) {
+  if(updateReceived + len > updateSize) {
+    return false;
+  }
+
+  for(uint32_t i = 0; i < len; i++) {
+    while(updateReceived - updateAcked >= UPDATE_WINDOW_SIZE) {
+      if(updateState == remoteunit_update_failed) {
+        return false;
+      }
+      osDelay(1);
+    }
+
+    updateBuffer[updateReceived % UPDATE_WINDOW_SIZE] = pData[i];
+    updateReceived++;
+  }
+  updateCrc = remUnit_crc32(updateCrc, pData, len);
+
+  return updateState != remoteunit_update_failed;
+}
+
+
+/*******************************************************************************
+ * Waits until the remote-unit verified the complete image, restarted and runs
+ * the new image (osDelay(10) is called while waiting).
+ *
+ * @return true if successful
+ *******************************************************************************/
+bool remoteunit_finishUpdate( void ) {
+  while(updateState != remoteunit_update_done && updateState != remoteunit_update_failed) {
+    osDelay(10);
+  }
+
+  return updateState == remoteunit_update_done;
+}
+
+
+/*******************************************************************************
+ * Aborts a running update, the remote-unit discards the image as soon as it
+ * receives normal frames again.
+ *
+ * @return nothing
+ *******************************************************************************/
+void remoteunit_abortUpdate( void ) {
+  if(remUnit_isUpdating()) {
+    updateState = remoteunit_update_failed;
+  }
+}
+
+
 /*******************************************************************************
  * Reads in the ADC values, modifies the data according calibration stored in
  * the config-struct and adds the data to the states-struct
  *
  * @param pConfig A pointer to the currently loaded config.
  * @param pStates A pointer to the current states of the I/Os.
+ * @param pJoyRaw A pointer to an array for the raw ADC values of the axes.
  * @return nothing
  *******************************************************************************/
-static inline void remUnit_getAxis( RemUnit_Config_t* pConfig, RemUnit_IOStates_t* pStates ) {
-  //Copy old analog values
-  uint32_t aRemote[4] = { pStates->analog[pConfig->axis_config[analog_out_x]],
-                          pStates->analog[pConfig->axis_config[analog_out_y]],
-                          pStates->analog[pConfig->axis_config[analog_out_z]],
-                          pStates->analog[pConfig->axis_config[analog_out_w]]};
-  uint32_t aJoystick[4] = {0};
+static inline void remUnit_getAxis( RemUnit_Config_t* pConfig, RemUnit_IOStates_t* pStates,
+    uint32_t* pJoyRaw ) {
+  uint32_t aRemote[CONFIG_ANALOG_CHANNELS];
+  uint32_t aJoystick[CONFIG_JOYSTICK_AXES] = {0};
   int32_t val1, val2;
+  bool sendADC = flag_sendADC && (interestFullFrames >= INTEREST_SETTLE_FRAMES ||
+      !system_isRemoteConnected());
+  uint32_t adcMask = sendADC ? ADC1_ALL_CHANNELS : pConfig->plan_adcMask;
 
-  //Get ADCs
-  adc1_start();
-  adc1_getADC(aJoystick);
+  //Copy old analog values
+  for(Config_Analog_Out_t out = analog_out_x; out < CONFIG_ANALOG_CHANNELS; out++) {
+    aRemote[out] = pStates->analog[pConfig->axis_config[out]];
+  }
+
+  //Get ADCs (only the mapped axes, all axes if requested by another task)
+  if(adcMask != 0) {
+    adc1_setChannels(adcMask);
+    adc1_start();
+    adc1_getADC(aJoystick);
+  }
 
   //Normalize pressure sensor
-  val1 = system_getSupplyVoltage();
-  if(val1 > 0) {
-    aJoystick[3] = (aJoystick[3] * 4096) / val1;
+  if(adcMask & (1 << analog_in_w)) {
+    val1 = system_getSupplyVoltage();
+    if(val1 > 0) {
+      aJoystick[analog_in_w] = (aJoystick[analog_in_w] * 4096) / val1;
+    }
+  }
+
+  //Provide raw values for recorder
+  for(uint32_t i = 0; i < CONFIG_JOYSTICK_AXES; i++) {
+    pJoyRaw[i] = aJoystick[i];
   }
 
   //Check if results are needed by another task
-  if(flag_sendADC) {
-    adcStates.rem_x = aRemote[0];
-    adcStates.rem_y = aRemote[1];
-    adcStates.rem_z = aRemote[2];
-    adcStates.rem_w = aRemote[3];
-    adcStates.joy_x = aJoystick[0];
-    adcStates.joy_y = aJoystick[1];
-    adcStates.joy_z = aJoystick[2];
-    adcStates.joy_w = aJoystick[3];
+  if(sendADC) {
+    for(uint32_t i = 0; i < CONFIG_ANALOG_CHANNELS; i++) {
+      adcStates.rem[i] = aRemote[i];
+    }
+    for(uint32_t i = 0; i < CONFIG_JOYSTICK_AXES; i++) {
+      adcStates.joy[i] = aJoystick[i];
+    }
     flag_sendADC = false;
   }
 
   //Add results to sturct (incl. calc for calibration)
-  for(Config_Analog_Out_t out = analog_out_x; out <= analog_out_w; out++) {
+  for(uint32_t i = 0; i < pConfig->plan_numCalibrated; i++) {
+    Config_Analog_Out_t out = pConfig->plan_calibrated[i];
     Config_Analog_In_t in = pConfig->aOut[out];
 
-    switch(in) {
-      case analog_in_x:
-      case analog_in_y:
-      case analog_in_z:
-      case analog_in_w:
-        //calc new value according to calibration (see "/docs/calibration_formula.pdf" for more informations)
-        if(pConfig->inInverted[out]) {
-          val2 = (pConfig->middpoint_in[out]*2) - aJoystick[in];
-        } else {
-          val2 = aJoystick[in];
-        }
-
-        val1 = (pConfig->k_num[out] * val2) / pConfig->k_den[out];
+    //calc new value according to calibration (see "/docs/calibration_formula.pdf" for more informations)
+    if(pConfig->inInverted[out]) {
+      val2 = (pConfig->middpoint_in[out]*2) - aJoystick[in];
+    } else {
+      val2 = aJoystick[in];
+    }
 
-        if(val2 < pConfig->threas_low[out]) {
-          val1 += pConfig->d_low[out];
-        } else if (val2 > pConfig->threas_high[out]) {
-          val1 += pConfig->d_high[out];
-        } else {
-          val1 = pConfig->middpoint[out];
-        }
+    val1 = (pConfig->k_num[out] * val2) / pConfig->k_den[out];
 
-        if(pConfig->outInverted[out]) {
-          val1 = (pConfig->middpoint[out]*2) - val1;
-        }
+    if(val2 < pConfig->threas_low[out]) {
+      val1 += pConfig->d_low[out];
+    } else if (val2 > pConfig->threas_high[out]) {
+      val1 += pConfig->d_high[out];
+    } else {
+      val1 = pConfig->middpoint[out];
+    }
 
-        if(val1 > 4095)  val1 = 4095;
-        if(val1 < 0)     val1 = 0;
+    if(pConfig->outInverted[out]) {
+      val1 = (pConfig->middpoint[out]*2) - val1;
+    }
 
-        pStates->analog[pConfig->axis_config[out]] = (uint32_t)val1;
-        break;
+    if(val1 > 4095)  val1 = 4095;
+    if(val1 < 0)     val1 = 0;
 
-      case analog_in_rx:
-      case analog_in_ry:
-      case analog_in_rz:
-      case analog_in_rw:
-        //copy value from remote states
-        pStates->analog[pConfig->axis_config[out]] = aRemote[in-analog_in_rx];
-        break;
+    pStates->analog[pConfig->axis_config[out]] = (uint32_t)val1;
+  }
 
-      case analog_in_none:
-      default:
-        //copy original value
-        pStates->analog[pConfig->axis_config[out]] = aRemote[out];
-        break;
-    }
+  //Copy values from remote states
+  for(uint32_t i = 0; i < pConfig->plan_numRemapped; i++) {
+    Config_Analog_Out_t out = pConfig->plan_remapped[i];
+    pStates->analog[pConfig->axis_config[out]] = aRemote[pConfig->aOut[out]-analog_in_rx];
   }
 }
 
@@ -586,8 +901,18 @@ static inline void remUnit_getBuddyButtons( RemUnit_Config_t *pConfig,
     }
   }
 
-  //Add data to output and update LEDs
-  for(buddyId = 0; buddyId < 4; buddyId++) {
+  //Add data to output and update LEDs (unused buttons stay off)
+  for(uint32_t i = 0; i < pConfig->plan_numBuddyButtons; i++) {
+    buddyId = pConfig->plan_buddyButtons[i];
+
+    //Channels of buddy buttons do not forward pulses of the remote-unit
+    if(pConfig->bb_ch1[buddyId] != DIGITAL_PORT_NOT_USED) {
+      pIOStates->digitalPulses &= ~(1UL << pConfig->bb_ch1[buddyId]);
+    }
+    if(pConfig->bb_ch2[buddyId] != DIGITAL_PORT_NOT_USED) {
+      pIOStates->digitalPulses &= ~(1UL << pConfig->bb_ch2[buddyId]);
+    }
+
     switch(pBuddyStates[buddyId]) {
       case bbState_on_1:
         if(pConfig->bb_config[buddyId] == sysconf_switch_3pos) {
@@ -650,16 +975,12 @@ static inline void remUnit_getBuddyButtons( RemUnit_Config_t *pConfig,
 static void remUnit_resetBuddyButtons( BuddyButton_State_t* pStates ) {
   BuddyButtonMessage_t msg;
 
-  //Reset stats
-  pStates[buddyButton1] = bbState_off;
-  pStates[buddyButton2] = bbState_off;
-  pStates[buddyButton3] = bbState_off;
-  pStates[buddyButton4] = bbState_off;
-
-  //Reset LEDs
-  HAL_GPIO_WritePin(GPIOB, LED2_G_Pin | LED2_R_Pin | LED3_G_Pin | LED3_R_Pin, GPIO_PIN_RESET);
-  HAL_GPIO_WritePin(GPIOC, LED4_G_Pin | LED1_G_Pin | LED1_R_Pin, GPIO_PIN_RESET);
-  HAL_GPIO_WritePin(GPIOA, LED4_R_Pin, GPIO_PIN_RESET);
+  //Reset stats and LEDs
+  for(Config_BuddyButton_t btn = buddyButton1; btn < CONFIG_BUDDYBUTTONS; btn++) {
+    pStates[btn] = bbState_off;
+    HAL_GPIO_WritePin(buddyButtons_ledPorts[btn][0], buddyButtons_ledPins[btn][0], GPIO_PIN_RESET);
+    HAL_GPIO_WritePin(buddyButtons_ledPorts[btn][1], buddyButtons_ledPins[btn][1], GPIO_PIN_RESET);
+  }
 
   //Empty message queue
   while(osMessageWaiting(buddyButtonsMsgBox) > 0) {
@@ -670,110 +991,178 @@ static void remUnit_resetBuddyButtons( BuddyButton_State_t* pStates ) {
 
 
 /*******************************************************************************
- * Packs an IO-struct into a format, which can be sent to the remote-unit.
+ * Packs an IO-struct into a format, which can be sent to the remote-unit. Each
+ * analog value (12 bit) carries four digital channels in its upper nibble, the
+ * remaining digital channels are packed into the following bytes. Pulses
+ * between two frames of the remote-unit are forwarded by inverting the channel
+ * for one frame (cleared afterwards). The edge bytes are not used in this
+ * direction.
+ *
+ * The interest mask is appended to the digital channels.
  *
  * @param pData The data (IO-struct) which will be used to create the package.
- * @param pPackage The package which will be filled with data (uint8_t x[10])
+ * @param interest The inputs which should be sampled by the remote-unit.
+ * @param pPackage The package which will be filled with data (uint8_t x[REMOTEUNIT_FRAME_LENGTH])
  * @return nothing
  *******************************************************************************/
-static inline void remUnit_packData( RemUnit_IOStates_t* data, uint8_t* package ) {
-  package[0]  = (data->analog[0] >> 0) & 0xFF;
-  package[1]  = (data->analog[0] >> 8) & 0x0F;
-  package[1] |= ADD_GPIO_BIT(data->digital[ 0], 4);
-  package[1] |= ADD_GPIO_BIT(data->digital[ 1], 5);
-  package[1] |= ADD_GPIO_BIT(data->digital[ 2], 6);
-  package[1] |= ADD_GPIO_BIT(data->digital[ 3], 7);
-
-  package[2]  = (data->analog[1] >> 0) & 0xFF;
-  package[3]  = (data->analog[1] >> 8) & 0x0F;
-  package[3] |= ADD_GPIO_BIT(data->digital[ 4], 4);
-  package[3] |= ADD_GPIO_BIT(data->digital[ 5], 5);
-  package[3] |= ADD_GPIO_BIT(data->digital[ 6], 6);
-  package[3] |= ADD_GPIO_BIT(data->digital[ 7], 7);
-
-  package[4]  = (data->analog[2] >> 0) & 0xFF;
-  package[5]  = (data->analog[2] >> 8) & 0x0F;
-  package[5] |= ADD_GPIO_BIT(data->digital[ 8], 4);
-  package[5] |= ADD_GPIO_BIT(data->digital[ 9], 5);
-  package[5] |= ADD_GPIO_BIT(data->digital[10], 6);
-  package[5] |= ADD_GPIO_BIT(data->digital[11], 7);
-
-  package[6]  = (data->analog[3] >> 0) & 0xFF;
-  package[7]  = (data->analog[3] >> 8) & 0x0F;
-  package[7] |= ADD_GPIO_BIT(data->digital[12], 4);
-  package[7] |= ADD_GPIO_BIT(data->digital[13], 5);
-  package[7] |= ADD_GPIO_BIT(data->digital[14], 6);
-  package[7] |= ADD_GPIO_BIT(data->digital[15], 7);
-
-  package[8]  = ADD_GPIO_BIT(data->digital[16], 0);
-  package[8] |= ADD_GPIO_BIT(data->digital[17], 1);
-  package[8] |= ADD_GPIO_BIT(data->digital[18], 2);
-  package[8] |= ADD_GPIO_BIT(data->digital[19], 3);
-  package[8] |= ADD_GPIO_BIT(data->digital[20], 4);
-  package[8] |= ADD_GPIO_BIT(data->digital[21], 5);
-  package[8] |= ADD_GPIO_BIT(data->digital[22], 6);
-  package[8] |= ADD_GPIO_BIT(data->digital[23], 7);
-
-  package[9] = remUnit_calcCRC(package, 9);
+static inline void remUnit_packData( RemUnit_IOStates_t* data, uint64_t interest, uint8_t* package ) {
+  uint32_t ch = 0;
+  uint32_t pos = 0;
+
+  //Analog values incl. four digital channels
+  for(uint32_t i = 0; i < CONFIG_ANALOG_CHANNELS; i++) {
+    package[pos++] = (data->analog[i] >> 0) & 0xFF;
+    package[pos]   = (data->analog[i] >> 8) & 0x0F;
+    for(uint32_t bit = 4; bit < 8; bit++, ch++) {
+      package[pos] |= ADD_GPIO_BIT(data->digital[ch], bit) ^ ADD_PULSE_BIT(data->digitalPulses, ch, bit);
+    }
+    pos++;
+  }
+
+  //Remaining digital channels
+  for(uint32_t i = 0; i < REMOTEUNIT_FRAME_DIGITAL_BYTES; i++) {
+    package[pos] = 0;
+    for(uint32_t bit = 0; bit < 8 && ch < CONFIG_DIGITAL_CHANNELS; bit++, ch++) {
+      package[pos] |= ADD_GPIO_BIT(data->digital[ch], bit) ^ ADD_PULSE_BIT(data->digitalPulses, ch, bit);
+    }
+    pos++;
+  }
+  data->digitalPulses = 0;
+
+  //Edges (only sent by the remote-unit)
+  for(uint32_t i = 0; i < REMOTEUNIT_FRAME_EDGE_BYTES; i++) {
+    package[pos++] = 0;
+  }
+
+  //Interest mask
+  for(uint32_t i = 0; i < REMOTEUNIT_FRAME_INTEREST_BYTES; i++) {
+    package[pos++] = (interest >> (8*i)) & 0xFF;
+  }
+
+  package[pos] = remUnit_calcCRC(CRC_START_VALUE, package, pos);
 }
 
 
 /*******************************************************************************
  * Unpacks a package received from the remote-unit and stores its contents to
- * the IO-struct.
+ * the IO-struct. Instead of the interest mask, the remote-unit sends one of its
+ * statistics (id, 24 bit value little-endian).
+ *
+ * A channel with edges, whose level did not change since the last frame, was
+ * pressed and released in between (the level alone misses it). These pulses
+ * are stored to digitalPulses and forwarded by remUnit_packData().
  *
  * @param pData A pointer to the IO-struct which will be filled.
- * @param pPackage The package received from the remote-unit (uint8_t x[10])
+ * @param pPackage The package received from the remote-unit (uint8_t x[REMOTEUNIT_FRAME_LENGTH])
  * @return nothing
  *******************************************************************************/
 static inline void remUnit_unpackData( RemUnit_IOStates_t* pData, uint8_t* pPackage ) {
-  //Convert analog
-  pData->analog[0] = pPackage[0] | ((pPackage[1] & 0x0F) << 8);
-  pData->analog[1] = pPackage[2] | ((pPackage[3] & 0x0F) << 8);
-  pData->analog[2] = pPackage[4] | ((pPackage[5] & 0x0F) << 8);
-  pData->analog[3] = pPackage[6] | ((pPackage[7] & 0x0F) << 8);
+  uint32_t ch = 0;
+  uint32_t pos = 0;
+  uint32_t levels, edges = 0;
+
+  //Convert analog values incl. four digital channels
+  for(uint32_t i = 0; i < CONFIG_ANALOG_CHANNELS; i++) {
+    pData->analog[i] = pPackage[pos] | ((pPackage[pos+1] & 0x0F) << 8);
+    pos++;
+    for(uint32_t bit = 4; bit < 8; bit++) {
+      pData->digital[ch++] = EXTRACT_GPIO_VAL(pPackage[pos], bit);
+    }
+    pos++;
+  }
 
-  //Convert digital
-  pData->digital[ 0] = EXTRACT_GPIO_VAL(pPackage[1], 4);
-  pData->digital[ 1] = EXTRACT_GPIO_VAL(pPackage[1], 5);
-  pData->digital[ 2] = EXTRACT_GPIO_VAL(pPackage[1], 6);
-  pData->digital[ 3] = EXTRACT_GPIO_VAL(pPackage[1], 7);
+  //Convert remaining digital channels
+  for(uint32_t i = 0; i < REMOTEUNIT_FRAME_DIGITAL_BYTES; i++) {
+    for(uint32_t bit = 0; bit < 8 && ch < CONFIG_DIGITAL_CHANNELS; bit++) {
+      pData->digital[ch++] = EXTRACT_GPIO_VAL(pPackage[pos], bit);
+    }
+    pos++;
+  }
 
-  pData->digital[ 4] = EXTRACT_GPIO_VAL(pPackage[3], 4);
-  pData->digital[ 5] = EXTRACT_GPIO_VAL(pPackage[3], 5);
-  pData->digital[ 6] = EXTRACT_GPIO_VAL(pPackage[3], 6);
-  pData->digital[ 7] = EXTRACT_GPIO_VAL(pPackage[3], 7);
+  //Edges since the last frame
+  for(uint32_t i = 0; i < REMOTEUNIT_FRAME_EDGE_BYTES; i++) {
+    edges |= (uint32_t)pPackage[pos++] << (8*i);
+  }
+  levels = remUnit_getDigitalWord(pData);
+  pData->digitalPulses = edges & ~(levels ^ pData->digitalIn);
+  pData->digitalIn = levels;
 
-  pData->digital[ 8] = EXTRACT_GPIO_VAL(pPackage[5], 4);
-  pData->digital[ 9] = EXTRACT_GPIO_VAL(pPackage[5], 5);
-  pData->digital[10] = EXTRACT_GPIO_VAL(pPackage[5], 6);
-  pData->digital[11] = EXTRACT_GPIO_VAL(pPackage[5], 7);
+  //Statistic of remote-unit
+  remUnit_storeRemoteStat(pPackage[pos], pPackage[pos+1] | (pPackage[pos+2] << 8) |
+      (pPackage[pos+3] << 16));
+}
 
-  pData->digital[12] = EXTRACT_GPIO_VAL(pPackage[7], 4);
-  pData->digital[13] = EXTRACT_GPIO_VAL(pPackage[7], 5);
-  pData->digital[14] = EXTRACT_GPIO_VAL(pPackage[7], 6);
-  pData->digital[15] = EXTRACT_GPIO_VAL(pPackage[7], 7);
 
-  pData->digital[16] = EXTRACT_GPIO_VAL(pPackage[8], 0);
-  pData->digital[17] = EXTRACT_GPIO_VAL(pPackage[8], 1);
-  pData->digital[18] = EXTRACT_GPIO_VAL(pPackage[8], 2);
-  pData->digital[19] = EXTRACT_GPIO_VAL(pPackage[8], 3);
-  pData->digital[20] = EXTRACT_GPIO_VAL(pPackage[8], 4);
-  pData->digital[21] = EXTRACT_GPIO_VAL(pPackage[8], 5);
-  pData->digital[22] = EXTRACT_GPIO_VAL(pPackage[8], 6);
-  pData->digital[23] = EXTRACT_GPIO_VAL(pPackage[8], 7);
+/*******************************************************************************
+ * Stores a statistic received from the remote-unit. Remote-units without
+ * statistics send id 0 (remoteunit_stat_none).
+ *
+ * @param id The id of the statistic (RemoteUnit_stat_t)
+ * @param value The value of the statistic
+ * @return nothing
+ *******************************************************************************/
+static inline void remUnit_storeRemoteStat( uint8_t id, uint32_t value ) {
+  switch(id) {
+    case remoteunit_stat_cycleTime:
+      remoteStats.cycleTime_us = value;
+      break;
+    case remoteunit_stat_inputsTime:
+      remoteStats.inputsTime_us = value;
+      break;
+    case remoteunit_stat_linkTime:
+      remoteStats.linkTime_us = value;
+      break;
+    case remoteunit_stat_outputsTime:
+      remoteStats.outputsTime_us = value;
+      break;
+    case remoteunit_stat_i2cTime:
+      remoteStats.i2cTime_us = value;
+      break;
+    case remoteunit_stat_dacTime:
+      remoteStats.dacTime_us = value;
+      break;
+    case remoteunit_stat_linkErrors:
+      remoteStats.linkErrors = value;
+      break;
+    case remoteunit_stat_i2cErrors:
+      remoteStats.i2cErrors = value;
+      break;
+    case remoteunit_stat_missedTicks:
+      remoteStats.missedTicks = value;
+      break;
+    case remoteunit_stat_resetCause:
+      remoteStats.resetCause = value;
+      break;
+    case remoteunit_stat_failovers:
+      remoteStats.failovers = value;
+      break;
+    case remoteunit_stat_failoverTime:
+      remoteStats.failoverTime_us = value;
+      break;
+    case remoteunit_stat_recoveryTime:
+      remoteStats.recoveryTime_us = value;
+      break;
+    case remoteunit_stat_cpuLoad:
+      remoteStats.cpuLoad = value;
+      break;
+    case remoteunit_stat_none:
+    default:
+      return;
+  }
+  remoteStats.valid = true;
 }
 
 
 /*******************************************************************************
  * Calculates the checksum from a given uint8_t-array 'pData' with length 'len'.
  *
+ * @param start Start value (CRC_START_VALUE or CRC_UPDATE_START)
  * @param pData A pointer to the data.
  * @param pPackage The size of the data-array
  * @return The CRC-Checksum
  *******************************************************************************/
-static uint8_t remUnit_calcCRC( uint8_t* pData, uint32_t len ) {
-  uint8_t crc = CRC_START_VALUE;
+static uint8_t remUnit_calcCRC( uint8_t start, uint8_t* pData, uint32_t len ) {
+  uint8_t crc = start;
 
   while (len--) {
     crc = crc8_table[crc ^ *pData++];
@@ -787,11 +1176,301 @@ static uint8_t remUnit_calcCRC( uint8_t* pData, uint32_t len ) {
  * Checks if the checksum of a package is correct. The checksum must be the
  * last byte of the package.
  *
+ * @param start Start value (CRC_START_VALUE or CRC_UPDATE_START)
  * @param pData A pointer to the data.
  * @param pPackage The size of the data-array.
  * @return true if checksum was correct.
  *******************************************************************************/
-static inline bool remUnit_checkCRC( uint8_t* data, uint32_t len ) {
-  uint8_t calculatedCRC = remUnit_calcCRC(data, len);
+static inline bool remUnit_checkCRC( uint8_t start, uint8_t* data, uint32_t len ) {
+  uint8_t calculatedCRC = remUnit_calcCRC(start, data, len);
   return (calculatedCRC == data[len]);
 }
+
+
+/*******************************************************************************
+ * Transfers one frame to/from the remote-unit and checks the received frame.
+ * CRC-failures and timeouts are counted in the link statistics.
+ *
+ * @param pTxData The package which will be sent (uint8_t x[REMOTEUNIT_FRAME_LENGTH])
+ * @param pRxData The buffer for the received package (uint8_t x[REMOTEUNIT_FRAME_LENGTH])
+ * @param crcStart Start value of the CRC (CRC_START_VALUE or CRC_UPDATE_START)
+ * @return state of the received frame
+ *******************************************************************************/
+static RemUnit_FrameState_t remUnit_transferFrame( uint8_t* pTxData, uint8_t* pRxData, uint8_t crcStart ) {
+  HAL_StatusTypeDef status;
+
+  HAL_GPIO_WritePin(RJ12_CS_Port, RJ12_CS_Pin, GPIO_PIN_RESET);
+  status = HAL_SPI_TransmitReceive(&hspi1, pTxData, pRxData, REMOTEUNIT_FRAME_LENGTH, 10);
+  HAL_GPIO_WritePin(RJ12_CS_Port, RJ12_CS_Pin, GPIO_PIN_SET);
+
+  if(status == HAL_ERROR) {
+    system_errorHandler();
+  }
+
+  if(status != HAL_OK) {
+    linkStats.timeouts++;
+    linkWindowErrors++;
+    return remUnit_frame_timeout;
+  }
+
+  if(!remUnit_checkCRC(crcStart, pRxData, REMOTEUNIT_FRAME_LENGTH-1)) {
+    linkStats.crcErrors++;
+    linkWindowErrors++;
+    return remUnit_frame_crcError;
+  }
+
+  return remUnit_frame_ok;
+}
+
+
+/*******************************************************************************
+ * Updates the link statistics after a communication cycle (incl. retries).
+ *
+ * @param frameReceived true if a valid frame was received in this cycle
+ * @return nothing
+ *******************************************************************************/
+static void remUnit_updateLinkStats( bool frameReceived ) {
+  uint32_t tick = HAL_GetTick();
+
+  if(frameReceived) {
+    linkStats.framesOk++;
+    linkStats.consecutiveLosses = 0;
+    if(!linkStats.linkUp) {
+      linkStats.linkUp = true;
+      linkUpSince = tick;
+    }
+  } else {
+    linkStats.consecutiveLosses++;
+    if(linkStats.consecutiveLosses > linkStats.maxConsecutiveLosses) {
+      linkStats.maxConsecutiveLosses = linkStats.consecutiveLosses;
+    }
+    if(linkStats.consecutiveLosses >= LINK_DOWN_THRESHOLD) {
+      linkStats.linkUp = false;
+    }
+  }
+
+  //Evaluation window for link health
+  if((tick - linkWindowStart) >= LINK_HEALTH_WINDOW) {
+    linkLastWindowErrors = linkWindowErrors;
+    linkWindowErrors = 0;
+    linkWindowStart = tick;
+  }
+}
+
+
+/*******************************************************************************
+ * Marks the link as down (e.g. if remote-unit is disconnected). The
+ * accumulated counters are kept.
+ *
+ * @return nothing
+ *******************************************************************************/
+static void remUnit_resetLink( void ) {
+  linkStats.linkUp = false;
+  linkStats.consecutiveLosses = 0;
+  linkWindowErrors = 0;
+  linkLastWindowErrors = 0;
+}
+
+
+/*******************************************************************************
+ * Combines the digital channels of the IO-struct to one word.
+ *
+ * @param pStates A pointer to the IO-struct.
+ * @return digital channels (bit 0 = channel 0, set = GPIO_PIN_SET)
+ *******************************************************************************/
+static inline uint32_t remUnit_getDigitalWord( RemUnit_IOStates_t* pStates ) {
+  uint32_t word = 0;
+
+  for(uint32_t i = 0; i < CONFIG_DIGITAL_CHANNELS; i++) {
+    word |= ADD_GPIO_BIT(pStates->digital[i], i);
+  }
+
+  return word;
+}
+
+
+/*******************************************************************************
+ * Checks if a firmware update of the remote-unit is running.
+ *
+ * @return true if update frames are sent instead of normal frames
+ *******************************************************************************/
+static inline bool remUnit_isUpdating( void ) {
+  return updateState >= remoteunit_update_begin && updateState <= remoteunit_update_reboot;
+}
+
+
+/*******************************************************************************
+ * Exchanges one frame of the firmware update with the remote-unit and advances
+ * the update according to its answer. The answer lags one frame, so up to
+ * UPDATE_MAX_INFLIGHT blocks are sent without acknowledge (no per-block
+ * handshake). After a lost frame, the blocks are resent from the last
+ * acknowledged one.
+ *
+ * @param pTxData Buffer for the package which will be sent
+ * @param pRxData Buffer for the received package
+ * @return nothing
+ *******************************************************************************/
+static void remUnit_updateStep( uint8_t* pTxData, uint8_t* pRxData ) {
+  RemUnit_FrameState_t frameState;
+  uint32_t acked;
+
+  if(!system_isRemoteConnected() || (HAL_GetTick() - updateLastProgress) > UPDATE_TIMEOUT) {
+    updateState = remoteunit_update_failed;
+    return;
+  }
+
+  remUnit_packUpdate(pTxData);
+  frameState = remUnit_transferFrame(pTxData, pRxData, CRC_UPDATE_START);
+
+  //The remote-unit stops answering while it restarts and installs the image.
+  //Afterwards it answers idle with the CRC of the installed image. Normal frames
+  //are not sent before, as they would discard an image which is not installed.
+  if(updateState == remoteunit_update_reboot) {
+    if(frameState != remUnit_frame_ok || pRxData[UPDATE_POS_MARKER] != UPDATE_MARKER) {
+      if(updateLostFrames < UPDATE_RESTART_FRAMES) {
+        updateLostFrames++;
+      }
+    } else if(updateLostFrames < UPDATE_RESTART_FRAMES || pRxData[0] != UPDATE_STATUS_IDLE) {
+      //Not restarted yet (single lost frame), request the restart again
+      updateLostFrames = 0;
+    } else if((pRxData[UPDATE_POS_DATA + 0] | (pRxData[UPDATE_POS_DATA + 1] << 8) |
+        (pRxData[UPDATE_POS_DATA + 2] << 16) | ((uint32_t)pRxData[UPDATE_POS_DATA + 3] << 24)) == updateCrc) {
+      updateState = remoteunit_update_done;
+    } else {
+      updateState = remoteunit_update_failed;
+    }
+    return;
+  }
+
+  //Lost frame or answer of another session: resend from last acknowledged block
+  if(frameState != remUnit_frame_ok || pRxData[UPDATE_POS_MARKER] != UPDATE_MARKER ||
+      pRxData[1] != updateSession) {
+    updateSent = updateAcked;
+    return;
+  }
+
+  if(pRxData[0] == UPDATE_STATUS_ERROR) {
+    updateState = remoteunit_update_failed;
+    return;
+  }
+
+  switch(updateState) {
+    case remoteunit_update_begin:
+      if(pRxData[0] == UPDATE_STATUS_RECEIVING) {
+        updateLastProgress = HAL_GetTick();
+        updateState = remoteunit_update_data;
+      }
+      break;
+
+    case remoteunit_update_data:
+      acked = (pRxData[2] | (pRxData[3] << 8)) * UPDATE_BLOCK_SIZE;
+      if(acked > updateAcked && acked < updateReceived + UPDATE_BLOCK_SIZE) {
+        updateAcked = acked;
+        updateLastProgress = HAL_GetTick();
+      }
+      if(updateSent < updateAcked || updateSent > updateAcked + UPDATE_MAX_INFLIGHT * UPDATE_BLOCK_SIZE) {
+        updateSent = updateAcked;
+      }
+      if(updateAcked >= updateReceived) {
+        //Waiting for the CLI, not for the remote-unit
+        updateLastProgress = HAL_GetTick();
+      }
+      if(updateAcked >= updateSize) {
+        updateState = remoteunit_update_end;
+      }
+      break;
+
+    case remoteunit_update_end:
+      if(pRxData[0] == UPDATE_STATUS_DONE) {
+        updateLastProgress = HAL_GetTick();
+        updateState = remoteunit_update_reboot;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+
+/*******************************************************************************
+ * Packs the next frame of the firmware update: Start, next block of the image
+ * (as soon as the CLI provided it), end with the CRC-32 or restart.
+ *
+ * @param pPackage The package which will be filled (uint8_t x[REMOTEUNIT_FRAME_LENGTH])
+ * @return nothing
+ *******************************************************************************/
+static inline void remUnit_packUpdate( uint8_t* pPackage ) {
+  uint32_t value = 0;
+  uint32_t block, pos;
+
+  for(uint32_t i = 0; i < REMOTEUNIT_FRAME_LENGTH - 1; i++) {
+    pPackage[i] = 0;
+  }
+  pPackage[0] = UPDATE_CMD_STATUS;
+  pPackage[1] = updateSession;
+
+  switch(updateState) {
+    case remoteunit_update_begin:
+      pPackage[0] = UPDATE_CMD_BEGIN;
+      value = updateSize;
+      break;
+
+    case remoteunit_update_data:
+      //Only complete blocks (the last one is padded)
+      if(updateSent < updateSize &&
+          (updateReceived - updateSent >= UPDATE_BLOCK_SIZE || updateReceived == updateSize)) {
+        block = updateSent / UPDATE_BLOCK_SIZE;
+        pPackage[0] = UPDATE_CMD_DATA;
+        pPackage[2] = (block >> 0) & 0xFF;
+        pPackage[3] = (block >> 8) & 0xFF;
+        for(uint32_t i = 0; i < UPDATE_BLOCK_SIZE; i++) {
+          pos = updateSent + i;
+          pPackage[UPDATE_POS_DATA + i] = (pos < updateSize) ? updateBuffer[pos % UPDATE_WINDOW_SIZE] : 0xFF;
+        }
+        updateSent += UPDATE_BLOCK_SIZE;
+      }
+      break;
+
+    case remoteunit_update_end:
+      pPackage[0] = UPDATE_CMD_END;
+      value = updateCrc;
+      break;
+
+    case remoteunit_update_reboot:
+      pPackage[0] = UPDATE_CMD_REBOOT;
+      break;
+
+    default:
+      break;
+  }
+
+  if(pPackage[0] != UPDATE_CMD_DATA) {
+    pPackage[UPDATE_POS_DATA + 0] = (value >> 0) & 0xFF;
+    pPackage[UPDATE_POS_DATA + 1] = (value >> 8) & 0xFF;
+    pPackage[UPDATE_POS_DATA + 2] = (value >> 16) & 0xFF;
+    pPackage[UPDATE_POS_DATA + 3] = (value >> 24) & 0xFF;
+  }
+  pPackage[UPDATE_POS_MARKER] = UPDATE_MARKER;
+  pPackage[REMOTEUNIT_FRAME_LENGTH - 1] = remUnit_calcCRC(CRC_UPDATE_START, pPackage, REMOTEUNIT_FRAME_LENGTH - 1);
+}
+
+
+/*******************************************************************************
+ * Calculates the CRC-32 (IEEE 802.3) of data. Can be chained, start with 0.
+ *
+ * @param crc CRC of the previous data (0 for the first call)
+ * @param pData The data
+ * @param len Length of the data
+ * @return CRC-32
+ *******************************************************************************/
+static uint32_t remUnit_crc32( uint32_t crc, const uint8_t* pData, uint32_t len ) {
+  crc = ~crc;
+  while(len--) {
+    crc ^= *pData++;
+    for(uint32_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? CRC32_POLYNOMIAL : 0);
+    }
+  }
+  return ~crc;
+}
@@ -22,12 +22,17 @@
 
 /* Defines -------------------------------------------------------------------*/
 #define CHANGE_CONFIG_TIMEOUT   3000
+#define DISPLAY_TILE_ROWS       8         //128x64 pixel, 8 pixel per tile
+#define FNV_OFFSET_BASIS        2166136261u
+#define FNV_PRIME               16777619u
 
 
 /* Prototypes ----------------------------------------------------------------*/
 void ui_task(void const *argument);
 static inline uint32_t ui_incrementConfig(uint32_t currentConfig, bool positivIncrement);
 static inline void ui_updateDisplayIfRequired(uint32_t currentConfig);
+static inline void ui_drawLinkHealth(uint32_t x, RemoteUnit_linkHealth_t health);
+static void ui_sendChangedTileRows(bool sendAll);
 static uint8_t ui_u8g2_spiInterface(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
 static uint8_t ui_u8g2_halInterface(U8X8_UNUSED u8x8_t *u8x8, U8X8_UNUSED uint8_t msg,
     U8X8_UNUSED uint8_t arg_int, U8X8_UNUSED void *arg_ptr);
@@ -41,6 +46,8 @@ static SPI_DMA_HandleTypeDef hspi;
 static SystemConfiguration_t* sysConfig;
 static Configuration_t* configurations;
 static bool flag_refreshDisplay;
+static uint32_t displayUpdateTime = 0;    //us, transfer of the last full frame
+static uint32_t tileRowHash[DISPLAY_TILE_ROWS];
 extern uint32_t system_watchdog_uiTask;
 
 static const unsigned char ui_symbol_usb[] = { 0x00, 0x00, 0x01, 0x80, 0x03,
@@ -63,6 +70,21 @@ static const unsigned char ui_symbol_teacher[] = { 0x03, 0xc0, 0x0f, 0xf0, 0x0e,
     0xfc, 0x3e, 0x7c, 0x3e, 0x7c, 0x3e, 0x7c, 0x3e, 0x7c, 0x3e, 0x7c, 0x3f,
     0xfc, 0x3f, 0xfc};
 
+static const unsigned char ui_symbol_linkGood[] = { 0x00, 0x0e, 0x00, 0x0e,
+    0x00, 0x0e, 0x00, 0x0e, 0x00, 0xee, 0x00, 0xee, 0x00, 0xee, 0x00, 0xee,
+    0x0e, 0xee, 0x0e, 0xee, 0x0e, 0xee, 0x0e, 0xee, 0xee, 0xee, 0xee, 0xee,
+    0xee, 0xee, 0xee, 0xee };
+
+static const unsigned char ui_symbol_linkDegraded[] = { 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x0e, 0x00, 0x0e, 0x00, 0x0e, 0x00, 0x0e, 0x00, 0xee, 0x00, 0xee,
+    0x00, 0xee, 0x00, 0xee, 0x00 };
+
+static const unsigned char ui_symbol_linkDown[] = { 0x00, 0x42, 0x00, 0x24,
+    0x00, 0x18, 0x00, 0x18, 0x00, 0x24, 0x00, 0x42, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xe0, 0x00, 0xe0, 0x00,
+    0xe0, 0x00, 0xe0, 0x00 };
+
 /* Code ----------------------------------------------------------------------*/
 
 /*******************************************************************************
@@ -91,6 +113,10 @@ void ui_init( void ) {
   GPIO_InitStruct.Pin = DISP_DC_Pin;
   HAL_GPIO_Init(DISP_DC_Port, &GPIO_InitStruct);
 
+  //Enable cycle counter (update time of the display)
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
   //Init SPI
   hspi.edge = SPI_DMA_EDGE_FIRST;
   hspi.polarity = SPI_DMA_POLARITY_HIGH;
@@ -127,6 +153,17 @@ void ui_updateDisplay( void ) {
 }
 
 
+/*******************************************************************************
+ * Returns the time needed to transfer the last full frame to the display
+ * (first frame and the periodic refresh, partial updates are not recorded).
+ *
+ * @return update time in us
+ *******************************************************************************/
+uint32_t ui_getDisplayUpdateTime( void ) {
+  return displayUpdateTime;
+}
+
+
 /*******************************************************************************
  * Initializes the task.
  *
@@ -221,7 +258,7 @@ static inline uint32_t ui_incrementConfig(uint32_t currentConfig, bool positivIn
  * @return nothing
  *******************************************************************************/
 static inline void ui_updateDisplayIfRequired( uint32_t currentConfig ) {
-  uint32_t strWidth;
+  uint32_t strWidth, start;
   char slotBuf[] = "Slot 00";
 
   static uint32_t displayedConfig = 0xFF;
@@ -229,16 +266,19 @@ static inline void ui_updateDisplayIfRequired( uint32_t currentConfig ) {
   static bool old_remoteConnected = false;
   static bool old_poweredViaUSB = false;
   static bool old_teacherMode = false;
+  static RemoteUnit_linkHealth_t old_linkHealth = remoteunit_link_down;
   static uint8_t blink = 3;
-  static uint8_t continuouseRefresh = 50;
+  static uint8_t continuouseRefresh = 0;   //Send the complete first frame
 
   bool usbConnected = system_isUSBConnected();
   bool remoteConnected = system_isRemoteConnected();
   bool poweredViaUSB = system_isPoweredViaUSB();
   bool teacherMode = remoteunit_isTeachermodeActive();
+  RemoteUnit_linkHealth_t linkHealth = remoteunit_getLinkHealth();
 
-  //Refresh display every 5s, even if nothing was changed
-  if(continuouseRefresh == 0) {
+  //Refresh whole display every 5s, even if nothing was changed
+  bool fullRefresh = (continuouseRefresh == 0);
+  if(fullRefresh) {
     continuouseRefresh = 50;
     flag_refreshDisplay = true;
   }
@@ -247,7 +287,8 @@ static inline void ui_updateDisplayIfRequired( uint32_t currentConfig ) {
   if (displayedConfig != currentConfig || old_usbConnected != usbConnected
       || old_remoteConnected != remoteConnected || displayedConfig != sysConfig->currentSlot
       || old_poweredViaUSB != poweredViaUSB || flag_refreshDisplay
-      || old_teacherMode != teacherMode || blink < 3) {
+      || old_teacherMode != teacherMode || old_linkHealth != linkHealth
+      || blink < 3) {
     flag_refreshDisplay = false;
 
     //Get the configuration
@@ -293,14 +334,16 @@ static inline void ui_updateDisplayIfRequired( uint32_t currentConfig ) {
       }
     }
 
-    //Display connected interfaces
+    //Display connected interfaces (incl. link health of remote-unit)
     if(usbConnected && remoteConnected) {
       u8g2_DrawBitmap(&u8g2, 0, 0, 2, 16, ui_symbol_usb);
       u8g2_DrawBitmap(&u8g2, 20, 0, 2, 16, ui_symbol_remote);
+      ui_drawLinkHealth(38, linkHealth);
     } else if(usbConnected) {
       u8g2_DrawBitmap(&u8g2, 0, 0, 2, 16, ui_symbol_usb);
     } else if(remoteConnected) {
       u8g2_DrawBitmap(&u8g2, 0, 0, 2, 16, ui_symbol_remote);
+      ui_drawLinkHealth(18, linkHealth);
     }
 
     //Display teacher-mode
@@ -316,8 +359,12 @@ static inline void ui_updateDisplayIfRequired( uint32_t currentConfig ) {
       u8g2_DrawBitmap(&u8g2, 128-16, 0, 2, 16, ui_symbol_remote);
     }
 
-    //Update display
-    u8g2_SendBuffer(&u8g2);
+    //Update display (changed tile rows only, time is recorded for full frames)
+    start = DWT->CYCCNT;
+    ui_sendChangedTileRows(fullRefresh);
+    if(fullRefresh) {
+      displayUpdateTime = (DWT->CYCCNT - start) / (SystemCoreClock / 1000000);
+    }
 
     //Store current display states
     displayedConfig = currentConfig;
@@ -325,6 +372,60 @@ static inline void ui_updateDisplayIfRequired( uint32_t currentConfig ) {
     old_remoteConnected = remoteConnected;
     old_poweredViaUSB = poweredViaUSB;
     old_teacherMode = teacherMode;
+    old_linkHealth = linkHealth;
+  }
+}
+
+
+/*******************************************************************************
+ * Sends the tile rows of the frame buffer, whose content has changed since the
+ * last transfer, to the display. Changes are detected by a FNV-1a hash of each
+ * row, so no copy of the previous frame is needed.
+ *
+ * @param sendAll Send all tile rows, even if unchanged.
+ * @return nothing
+ *******************************************************************************/
+static void ui_sendChangedTileRows( bool sendAll ) {
+  uint32_t tileWidth = u8g2_GetBufferTileWidth(&u8g2);
+  uint32_t rowWords = tileWidth * 8 / sizeof(uint32_t);
+  uint8_t* row = u8g2_GetBufferPtr(&u8g2);
+  uint32_t hash, word;
+
+  for(uint32_t i = 0; i < DISPLAY_TILE_ROWS; i++, row += tileWidth * 8) {
+    hash = FNV_OFFSET_BASIS;
+    for(uint32_t j = 0; j < rowWords; j++) {
+      memcpy(&word, &row[j * sizeof(word)], sizeof(word));   //Buffer is not word aligned
+      hash = (hash ^ word) * FNV_PRIME;
+    }
+
+    if(sendAll || hash != tileRowHash[i]) {
+      u8x8_DrawTile(u8g2_GetU8x8(&u8g2), 0, i, tileWidth, row);
+      tileRowHash[i] = hash;
+    }
+  }
+  u8x8_RefreshDisplay(u8g2_GetU8x8(&u8g2));
+}
+
+
+/*******************************************************************************
+ * Draws the symbol for the link health of the remote-unit.
+ *
+ * @param x The x-position of the symbol.
+ * @param health The current link health.
+ * @return nothing
+ *******************************************************************************/
+static inline void ui_drawLinkHealth( uint32_t x, RemoteUnit_linkHealth_t health ) {
+  switch(health) {
+    case remoteunit_link_good:
+      u8g2_DrawBitmap(&u8g2, x, 0, 2, 16, ui_symbol_linkGood);
+      break;
+    case remoteunit_link_degraded:
+      u8g2_DrawBitmap(&u8g2, x, 0, 2, 16, ui_symbol_linkDegraded);
+      break;
+    case remoteunit_link_down:
+    default:
+      u8g2_DrawBitmap(&u8g2, x, 0, 2, 16, ui_symbol_linkDown);
+      break;
   }
 }
 
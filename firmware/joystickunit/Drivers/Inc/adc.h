@@ -7,9 +7,12 @@
 #ifndef __DRIVERS_INC_ADC_H_
 #define __DRIVERS_INC_ADC_H_
 
+#define ADC1_ALL_CHANNELS   0x0F
+
 void adc1_init( void );
 void adc2_init( void );
 void adc1_start( void );
+void adc1_setChannels( uint32_t mask );
 void adc2_start( void );
 void adc1_getADC( uint32_t* values );
 void adc2_getADC( uint32_t* values );
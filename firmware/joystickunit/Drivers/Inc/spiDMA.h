@@ -36,7 +36,7 @@ typedef struct {
 
 
 HAL_StatusTypeDef spiDMA_init( SPI_DMA_HandleTypeDef* hspi );
-HAL_StatusTypeDef spiDMA_transmit( SPI_DMA_HandleTypeDef* hspi, uint8_t* data, uint8_t size);
+HAL_StatusTypeDef spiDMA_transmit( SPI_DMA_HandleTypeDef* hspi, uint8_t* data, uint32_t size);
 void spiDMA_waitTillReady( void );
 
 
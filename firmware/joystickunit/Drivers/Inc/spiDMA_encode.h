@@ -0,0 +1,53 @@
+/*******************************************************************************
+* @file         : spiDMA_encode.h
+* @project      : 4D-Joystick, Joystick-Unit
+* @author       : Fabian Baer
+* @brief        : Encoding of the SPI bytes into BSRR words for the DMA, shared
+*                 by spiDMA.c and the host benchmark (tools/spiDMA_encodeBench.c)
+*******************************************************************************/
+
+#ifndef __DRIVERS_INC_SPIDMA_ENCODE_H_
+#define __DRIVERS_INC_SPIDMA_ENCODE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <board.h>
+
+#define SPIDMA_MOSI_PIN         DISP_MOSI_Pin
+#define SPIDMA_SCLK_PIN         DISP_CLK_Pin
+#define SPIDMA_WORDS_PER_BYTE   (8*2)   //Two BSRR writes per bit (clock low, clock high)
+
+#define SPIDMA_BITMASK_MOSI_SET    ((uint32_t)SPIDMA_MOSI_PIN <<  0)
+#define SPIDMA_BITMASK_MOSI_RESET  ((uint32_t)SPIDMA_MOSI_PIN << 16)
+#define SPIDMA_BITMASK_SCLK_SET    ((uint32_t)SPIDMA_SCLK_PIN <<  0)
+#define SPIDMA_BITMASK_SCLK_RESET  ((uint32_t)SPIDMA_SCLK_PIN << 16)
+
+//Words of a bit (clock low with data, clock high with data) and of a nibble (MSB first)
+#define SPIDMA_BIT_WORDS(bit) \
+  ((bit) ? (SPIDMA_BITMASK_SCLK_RESET | SPIDMA_BITMASK_MOSI_SET) : (SPIDMA_BITMASK_SCLK_RESET | SPIDMA_BITMASK_MOSI_RESET)), \
+  ((bit) ? (SPIDMA_BITMASK_SCLK_SET | SPIDMA_BITMASK_MOSI_SET) : (SPIDMA_BITMASK_SCLK_SET | SPIDMA_BITMASK_MOSI_RESET))
+#define SPIDMA_NIBBLE_WORDS(n) \
+  {SPIDMA_BIT_WORDS((n) & 0x8), SPIDMA_BIT_WORDS((n) & 0x4), SPIDMA_BIT_WORDS((n) & 0x2), SPIDMA_BIT_WORDS((n) & 0x1)}
+
+//BSRR words of all nibbles, a byte is encoded with two copies
+static const uint32_t spiDMA_nibbleWords[16][SPIDMA_WORDS_PER_BYTE/2] = {
+    SPIDMA_NIBBLE_WORDS(0x0), SPIDMA_NIBBLE_WORDS(0x1), SPIDMA_NIBBLE_WORDS(0x2), SPIDMA_NIBBLE_WORDS(0x3),
+    SPIDMA_NIBBLE_WORDS(0x4), SPIDMA_NIBBLE_WORDS(0x5), SPIDMA_NIBBLE_WORDS(0x6), SPIDMA_NIBBLE_WORDS(0x7),
+    SPIDMA_NIBBLE_WORDS(0x8), SPIDMA_NIBBLE_WORDS(0x9), SPIDMA_NIBBLE_WORDS(0xA), SPIDMA_NIBBLE_WORDS(0xB),
+    SPIDMA_NIBBLE_WORDS(0xC), SPIDMA_NIBBLE_WORDS(0xD), SPIDMA_NIBBLE_WORDS(0xE), SPIDMA_NIBBLE_WORDS(0xF)};
+
+
+/*******************************************************************************
+ * Encodes one byte (MSB first) into the BSRR words for the DMA.
+ *
+ * @param byte The byte
+ * @param pBuffer The words (SPIDMA_WORDS_PER_BYTE)
+ * @return nothing
+ *******************************************************************************/
+static inline void spiDMA_encodeByte( uint8_t byte, uint32_t* pBuffer ) {
+  memcpy(&pBuffer[0], spiDMA_nibbleWords[byte >> 4], sizeof(spiDMA_nibbleWords[0]));
+  memcpy(&pBuffer[SPIDMA_WORDS_PER_BYTE/2], spiDMA_nibbleWords[byte & 0x0F], sizeof(spiDMA_nibbleWords[0]));
+}
+
+
+#endif /* __DRIVERS_INC_SPIDMA_ENCODE_H_ */
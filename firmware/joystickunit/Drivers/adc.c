@@ -15,6 +15,11 @@
 
 /* Defines -------------------------------------------------------------------*/
 #define ADC_SAMPLE_TIME   ADC_SAMPLETIME_47CYCLES_5
+#define ADC1_CHANNELS     4
+
+
+/* Prototypes ----------------------------------------------------------------*/
+static void adc1_configSequence( uint32_t mask );
 
 
 /* Variables -----------------------------------------------------------------*/
@@ -22,7 +27,13 @@ static ADC_HandleTypeDef hadc1;
 static ADC_HandleTypeDef hadc2;
 static DMA_HandleTypeDef hdma2_3;
 static DMA_HandleTypeDef hdma2_4;
-static uint32_t adc1_results[4];
+static uint32_t adc1_results[ADC1_CHANNELS];
+static uint32_t adc1_mask = 0;
+static uint32_t adc1_numConversions = 0;
+static const uint32_t adc1_channels[ADC1_CHANNELS] = {
+    JOYSTICK_X_Channel, JOYSTICK_Y_Channel, JOYSTICK_Z_Channel, JOYSTICK_W_Channel};
+static const uint32_t adc1_ranks[ADC1_CHANNELS] = {
+    ADC_REGULAR_RANK_1, ADC_REGULAR_RANK_2, ADC_REGULAR_RANK_3, ADC_REGULAR_RANK_4};
 static uint32_t adc2_results[3];
 static uint32_t adc1_convFinishFlag = 0;
 static uint32_t adc2_convFinishFlag = 0;
@@ -37,7 +48,6 @@ static uint32_t adc2_convFinishFlag = 0;
  *******************************************************************************/
 void adc1_init( void ) {
   GPIO_InitTypeDef GPIO_InitStruct = {0};
-  ADC_ChannelConfTypeDef sConfig = {0};
   ADC_MultiModeTypeDef multimode = {0};
 
   //Init peripherals
@@ -83,34 +93,8 @@ void adc1_init( void ) {
     system_errorHandler();
   }
 
-  //Configure sequencer
-  sConfig.Channel = JOYSTICK_X_Channel;
-  sConfig.Rank = ADC_REGULAR_RANK_1;
-  sConfig.SamplingTime = ADC_SAMPLE_TIME;
-  sConfig.SingleDiff  = ADC_SINGLE_ENDED;
-  sConfig.OffsetNumber = ADC_OFFSET_NONE;
-  sConfig.Offset = 0;
-  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK) {
-    system_errorHandler();
-  }
-
-  sConfig.Channel = JOYSTICK_Y_Channel;
-  sConfig.Rank = ADC_REGULAR_RANK_2;
-  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK) {
-    system_errorHandler();
-  }
-
-  sConfig.Channel = JOYSTICK_Z_Channel;
-  sConfig.Rank = ADC_REGULAR_RANK_3;
-  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK) {
-    system_errorHandler();
-  }
-
-  sConfig.Channel = JOYSTICK_W_Channel;
-  sConfig.Rank = ADC_REGULAR_RANK_4;
-  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK) {
-    system_errorHandler();
-  }
+  //Configure sequencer (all channels)
+  adc1_configSequence(ADC1_ALL_CHANNELS);
 
   //Init DMA
   hdma2_3.Instance = DMA2_Channel3;
@@ -226,7 +210,24 @@ void adc2_init(void) {
  * @return nothing
  *******************************************************************************/
 void adc1_start( void ) {
-  HAL_ADC_Start_DMA(&hadc1, adc1_results, 4);
+  HAL_ADC_Start_DMA(&hadc1, adc1_results, adc1_numConversions);
+}
+
+
+/*******************************************************************************
+ * Selects the channels of ADC1 which are converted. The sequence is only
+ * reconfigured if the selection has changed. Must not be called while a
+ * conversion is ongoing.
+ *
+ * @param mask The channels to convert (bit 0 = X, bit 1 = Y, ...), not 0
+ * @return nothing
+ *******************************************************************************/
+void adc1_setChannels( uint32_t mask ) {
+  mask &= ADC1_ALL_CHANNELS;
+
+  if(mask != adc1_mask && mask != 0) {
+    adc1_configSequence(mask);
+  }
 }
 
 
@@ -283,12 +284,15 @@ void DMA2_Channel4_IRQHandler( void ) {
 
 
 /*******************************************************************************
- * Blocking wait for ADC1 to be finished. Results are returned.
+ * Blocking wait for ADC1 to be finished. Results are returned, channels which
+ * are not selected by adc1_setChannels() are not modified.
  *
  * @param values The results of the ADC conversion (array of size 4)
  * @return nothing
  *******************************************************************************/
 void adc1_getADC( uint32_t* values ) {
+  uint32_t rank = 0;
+
   //Wait for flag
   while(adc1_convFinishFlag == 0);
 
@@ -296,10 +300,11 @@ void adc1_getADC( uint32_t* values ) {
   adc1_convFinishFlag = 0;
 
   //Copy result
-  values[0] = adc1_results[0];
-  values[1] = adc1_results[1];
-  values[2] = adc1_results[2];
-  values[3] = adc1_results[3];
+  for(uint32_t i = 0; i < ADC1_CHANNELS; i++) {
+    if(adc1_mask & (1 << i)) {
+      values[i] = adc1_results[rank++];
+    }
+  }
 }
 
 
@@ -324,3 +329,39 @@ void adc2_getADC( uint32_t* values ) {
   values[1] = adc2_results[1];
   values[2] = adc2_results[2];
 }
+
+
+/*******************************************************************************
+ * Configures the regular sequence of ADC1 to convert the selected channels.
+ *
+ * @param mask The channels to convert (bit 0 = X, bit 1 = Y, ...), not 0
+ * @return nothing
+ *******************************************************************************/
+static void adc1_configSequence( uint32_t mask ) {
+  ADC_ChannelConfTypeDef sConfig = {0};
+  uint32_t rank = 0;
+
+  //Set length of sequence
+  hadc1.Init.NbrOfConversion = __builtin_popcount(mask);
+  if (HAL_ADC_Init(&hadc1) != HAL_OK) {
+    system_errorHandler();
+  }
+
+  //Configure sequencer
+  sConfig.SamplingTime = ADC_SAMPLE_TIME;
+  sConfig.SingleDiff  = ADC_SINGLE_ENDED;
+  sConfig.OffsetNumber = ADC_OFFSET_NONE;
+  sConfig.Offset = 0;
+  for(uint32_t i = 0; i < ADC1_CHANNELS; i++) {
+    if(mask & (1 << i)) {
+      sConfig.Channel = adc1_channels[i];
+      sConfig.Rank = adc1_ranks[rank++];
+      if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK) {
+        system_errorHandler();
+      }
+    }
+  }
+
+  adc1_mask = mask;
+  adc1_numConversions = rank;
+}
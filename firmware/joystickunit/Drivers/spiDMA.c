@@ -6,36 +6,47 @@
 *******************************************************************************/
 
 /* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
 #include <board.h>
 #include <stm32l4xx_hal.h>
 #include <spiDMA.h>
+#include <spiDMA_encode.h>
 #include <cmsis_os.h>
 
 
 /* Defines -------------------------------------------------------------------*/
-#define TX_BUFFERSIZE       256
+#define TX_CHUNK_BYTES      6       //Bytes encoded per half of the ping-pong buffer
+#define TX_WORDS_PER_BYTE   SPIDMA_WORDS_PER_BYTE
+#define TX_HALF_WORDS       (TX_CHUNK_BYTES*TX_WORDS_PER_BYTE)
+#define WAIT_TIMEOUT        50      //ms, a transfer which takes longer is aborted
+#define IRQ_PRIORITY        configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY  //Highest priority allowed to use the RTOS
 #define OUTPUT_PORT         DISP_MOSI_Port
-#define MOSI_PIN            DISP_MOSI_Pin
-#define SCLK_PIN            DISP_CLK_Pin
+#define MOSI_PIN            SPIDMA_MOSI_PIN
+#define SCLK_PIN            SPIDMA_SCLK_PIN
 
 
 /* Macros --------------------------------------------------------------------*/
-#define BITMASK_MOSI_SET    (MOSI_PIN <<  0)
-#define BITMASK_MOSI_RESET  (MOSI_PIN << 16)
-#define BITMASK_SCLK_SET    (SCLK_PIN <<  0)
-#define BITMASK_SCLK_RESET  (SCLK_PIN << 16)
+#define BITMASK_IDLE        SPIDMA_BITMASK_SCLK_SET   //No clock edge, pads the last half
 
 
 /* Prototypes ----------------------------------------------------------------*/
 static inline HAL_StatusTypeDef spiDMA_initTimer( SPI_DMA_HandleTypeDef* hspi );
 static inline HAL_StatusTypeDef spiDMA_initDMA( SPI_DMA_HandleTypeDef* hspi );
+static bool spiDMA_encodeChunk( uint32_t* pBuffer );
+static inline void spiDMA_stop( void );
+static void spiDMA_abort( void );
 
 
 /* Variables -----------------------------------------------------------------*/
 static TIM_HandleTypeDef htim1;
 static DMA_HandleTypeDef hdma;
 static SPI_DMA_HandleTypeDef* pHspi;
-static uint32_t txBuffer[TX_BUFFERSIZE*8*2];
+static osSemaphoreDef(hsem_ready);
+static osSemaphoreId(hsem_ready);
+static uint32_t txBuffer[2*TX_HALF_WORDS];     //Ping-pong buffer (circular DMA)
+static const uint8_t* txData;                   //Next byte to encode
+static uint32_t txRemaining;                    //Bytes not encoded yet
+static uint32_t txHalvesPending;                //Halves with data, not sent yet
 
 
 /* Code ----------------------------------------------------------------------*/
@@ -57,6 +68,13 @@ HAL_StatusTypeDef spiDMA_init( SPI_DMA_HandleTypeDef* hspi ) {
     hspi->state = SPI_DMA_STATE_RESET;
   }
 
+  //Init semaphore (released by the interrupt at the end of a transfer)
+  hsem_ready = osSemaphoreCreate(osSemaphore(hsem_ready), 1);
+  if(hsem_ready == NULL) {
+    hspi->state = SPI_DMA_STATE_ERROR;
+    return HAL_ERROR;
+  }
+
   //Init peripherals
 
   __DMA1_CLK_ENABLE();
@@ -145,7 +163,7 @@ static inline HAL_StatusTypeDef spiDMA_initDMA( SPI_DMA_HandleTypeDef* hspi ) {
   hdma.Init.MemInc = DMA_MINC_ENABLE;
   hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
   hdma.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
-  hdma.Init.Mode = DMA_NORMAL;
+  hdma.Init.Mode = DMA_CIRCULAR;
   hdma.Init.Priority = DMA_PRIORITY_HIGH;
   __HAL_LINKDMA(&htim1, hdma[1], hdma);
 
@@ -157,8 +175,8 @@ static inline HAL_StatusTypeDef spiDMA_initDMA( SPI_DMA_HandleTypeDef* hspi ) {
   hdma.Instance->CPAR = (uint32_t)(&(OUTPUT_PORT->BSRR));
   hdma.Instance->CMAR = (uint32_t)(txBuffer);
 
-  //Enable DMA interrupt
-  HAL_NVIC_SetPriority(DMA1_Channel2_IRQn, 0, 0);
+  //Enable DMA interrupt (signals the semaphore, must not be above the RTOS limit)
+  HAL_NVIC_SetPriority(DMA1_Channel2_IRQn, IRQ_PRIORITY, 0);
   HAL_NVIC_EnableIRQ(DMA1_Channel2_IRQn);
 
   return HAL_OK;
@@ -169,13 +187,19 @@ static inline HAL_StatusTypeDef spiDMA_initDMA( SPI_DMA_HandleTypeDef* hspi ) {
  * Transmits a message via SPI in non-blocking mode. If a transfer is already in
  * progress, the function blocks till SPI gets free.
  *
+ * The bits are encoded on the fly into a small ping-pong buffer, which is sent
+ * by the circular DMA. The half-transfer and transfer-complete interrupts
+ * refill the half, which was just sent, so messages of any length are sent in
+ * one continuous transfer. Messages up to 2*TX_CHUNK_BYTES are encoded at once,
+ * longer messages must stay valid until the transfer has finished.
+ *
  * @param hspi A pointer to the SPI handle
  * @param data A pointer to the data-struct to send
  * @param size The number of bytes to send
  * @return HAL_OK in case of success.
  *******************************************************************************/
-HAL_StatusTypeDef spiDMA_transmit( SPI_DMA_HandleTypeDef* hspi, uint8_t* data, uint8_t size ) {
-  if (size > TX_BUFFERSIZE || size == 0 || hspi->state == SPI_DMA_STATE_ERROR
+HAL_StatusTypeDef spiDMA_transmit( SPI_DMA_HandleTypeDef* hspi, uint8_t* data, uint32_t size ) {
+  if (size == 0 || hspi->state == SPI_DMA_STATE_ERROR
       || hspi->state == SPI_DMA_STATE_RESET) {
     return HAL_ERROR;
   }
@@ -184,29 +208,19 @@ HAL_StatusTypeDef spiDMA_transmit( SPI_DMA_HandleTypeDef* hspi, uint8_t* data, u
   spiDMA_waitTillReady();
   hspi->state = SPI_DMA_STATE_BUSY;
 
-  //Prepare data
-  uint32_t buffer_cnt = 0;
-  for(uint32_t byte_cnt = 0; byte_cnt < size; byte_cnt++) {
-    for(uint32_t bit_cnt = 0; bit_cnt < 8; bit_cnt++) {
-      if((data[byte_cnt] & (1 << (7-bit_cnt))) != 0) {
-        txBuffer[buffer_cnt++] = BITMASK_SCLK_RESET | BITMASK_MOSI_SET ;
-      } else {
-        txBuffer[buffer_cnt++] = BITMASK_SCLK_RESET | BITMASK_MOSI_RESET;
-      }
-
-      if((data[byte_cnt] & (1 << (7-bit_cnt))) != 0) {
-        txBuffer[buffer_cnt++] = BITMASK_SCLK_SET | BITMASK_MOSI_SET;
-      } else {
-        txBuffer[buffer_cnt++] = BITMASK_SCLK_SET | BITMASK_MOSI_RESET;
-      }
-    }
-  }
+  //Prepare both halves
+  txData = data;
+  txRemaining = size;
+  txHalvesPending = 0;
+  txHalvesPending += spiDMA_encodeChunk(&txBuffer[0]) ? 1 : 0;
+  txHalvesPending += spiDMA_encodeChunk(&txBuffer[TX_HALF_WORDS]) ? 1 : 0;
 
-  //Configure DMA transfer length
-  hdma.Instance->CNDTR = buffer_cnt;
+  //Configure DMA transfer length (whole ping-pong buffer, restarted by the DMA)
+  hdma.Instance->CNDTR = 2*TX_HALF_WORDS;
+  __HAL_DMA_CLEAR_FLAG(&hdma, __HAL_DMA_GET_GI_FLAG_INDEX(&hdma));
 
   //Enable peripherals
-  __HAL_DMA_ENABLE_IT(&hdma, DMA_IT_TC);
+  __HAL_DMA_ENABLE_IT(&hdma, DMA_IT_HT | DMA_IT_TC);
   __HAL_TIM_ENABLE_DMA(&htim1, TIM_DMA_CC1);
   __HAL_DMA_ENABLE(&hdma);
   __HAL_TIM_ENABLE(&htim1);
@@ -216,32 +230,108 @@ HAL_StatusTypeDef spiDMA_transmit( SPI_DMA_HandleTypeDef* hspi, uint8_t* data, u
 
 
 /*******************************************************************************
- * Waits for the end of the current transfer. If RTOS is active, it will use
- * osDelay(1) for this, else it uses a blocking while-loop.
+ * Encodes the next bytes of the message into one half of the ping-pong buffer
+ * (see spiDMA_encodeByte()). Behind the end of the message, the half is padded
+ * with idle words (no clock edge), as the DMA might continue for a few words
+ * until it is stopped.
+ *
+ * @param pBuffer The half of the ping-pong buffer (TX_HALF_WORDS)
+ * @return true if the half contains data
+ *******************************************************************************/
+static bool spiDMA_encodeChunk( uint32_t* pBuffer ) {
+  uint32_t buffer_cnt = 0;
+  bool hasData = (txRemaining > 0);
+
+  for(uint32_t byte_cnt = 0; byte_cnt < TX_CHUNK_BYTES && txRemaining > 0; byte_cnt++) {
+    spiDMA_encodeByte(*txData, &pBuffer[buffer_cnt]);
+    buffer_cnt += TX_WORDS_PER_BYTE;
+    txData++;
+    txRemaining--;
+  }
+
+  while(buffer_cnt < TX_HALF_WORDS) {
+    pBuffer[buffer_cnt++] = BITMASK_IDLE;
+  }
+
+  return hasData;
+}
+
+
+/*******************************************************************************
+ * Waits for the end of the current transfer. If RTOS is active, the task blocks
+ * on the semaphore released by the interrupt (a transfer, which does not end
+ * within WAIT_TIMEOUT, is aborted), else it uses a blocking while-loop.
+ * A token left from an earlier transfer only causes one more check.
  *
  * @return nothing
  *******************************************************************************/
 void spiDMA_waitTillReady( void ) {
   while(pHspi->state == SPI_DMA_STATE_BUSY) {
-    if(osKernelRunning()) {
-      osDelay(1);
+    if(osKernelRunning() && osSemaphoreWait(hsem_ready, WAIT_TIMEOUT) != osOK) {
+      spiDMA_abort();
     }
   }
 }
 
 
 /*******************************************************************************
- * Interrupt callback after transfer completes (disables all peripherals)
+ * Stops the transfer (disables all peripherals).
  *
  * @return nothing
  *******************************************************************************/
-void DMA1_Channel2_IRQHandler( void ) {
-  //Disable peripherals
+static inline void spiDMA_stop( void ) {
   __HAL_TIM_DISABLE(&htim1);
-  __HAL_DMA_DISABLE_IT(htim1.hdma[1], DMA_IT_TC);
-  __HAL_DMA_DISABLE(htim1.hdma[1]);
-
-  //Set new state
+  __HAL_DMA_DISABLE_IT(&hdma, DMA_IT_HT | DMA_IT_TC);
+  __HAL_DMA_DISABLE(&hdma);
+  __HAL_DMA_CLEAR_FLAG(&hdma, __HAL_DMA_GET_GI_FLAG_INDEX(&hdma));
   pHspi->state = SPI_DMA_STATE_READY;
-  __HAL_DMA_CLEAR_FLAG(&hdma, __HAL_DMA_GET_TC_FLAG_INDEX(&hdma));
+}
+
+
+/*******************************************************************************
+ * Aborts a transfer, which did not end in time (the interrupt is disabled
+ * meanwhile, so it cannot end the transfer concurrently).
+ *
+ * @return nothing
+ *******************************************************************************/
+static void spiDMA_abort( void ) {
+  HAL_NVIC_DisableIRQ(DMA1_Channel2_IRQn);
+  if(pHspi->state == SPI_DMA_STATE_BUSY) {
+    spiDMA_stop();
+  }
+  HAL_NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+}
+
+
+/*******************************************************************************
+ * Interrupt callback after a half of the ping-pong buffer was sent: Refills it
+ * with the next bytes. The transfer is stopped after the last half with data
+ * and the waiting task is woken up.
+ *
+ * @return nothing
+ *******************************************************************************/
+void DMA1_Channel2_IRQHandler( void ) {
+  uint32_t* pHalf;
+
+  if(__HAL_DMA_GET_FLAG(&hdma, __HAL_DMA_GET_HT_FLAG_INDEX(&hdma)) != RESET) {
+    __HAL_DMA_CLEAR_FLAG(&hdma, __HAL_DMA_GET_HT_FLAG_INDEX(&hdma));
+    pHalf = &txBuffer[0];
+  } else if(__HAL_DMA_GET_FLAG(&hdma, __HAL_DMA_GET_TC_FLAG_INDEX(&hdma)) != RESET) {
+    __HAL_DMA_CLEAR_FLAG(&hdma, __HAL_DMA_GET_TC_FLAG_INDEX(&hdma));
+    pHalf = &txBuffer[TX_HALF_WORDS];
+  } else {
+    __HAL_DMA_CLEAR_FLAG(&hdma, __HAL_DMA_GET_GI_FLAG_INDEX(&hdma));
+    return;
+  }
+
+  //Refill the half, which was just sent
+  txHalvesPending--;
+  if(spiDMA_encodeChunk(pHalf)) {
+    txHalvesPending++;
+  }
+
+  if(txHalvesPending == 0) {
+    spiDMA_stop();
+    osSemaphoreRelease(hsem_ready);
+  }
 }
@@ -0,0 +1,145 @@
+/*******************************************************************************
+* @file         : spiDMA_encodeBench.c
+* @project      : 4D-Joystick, Joystick-Unit
+* @author       : Fabian Baer
+* @brief        : Host benchmark of the byte encoding of spiDMA.c (bit loop vs.
+*                 nibble table of spiDMA_encode.h), checks that both create the
+*                 same DMA words.
+*
+* Build and run on the host (not part of the firmware), from this directory:
+*   gcc -O2 -DSTM32L476xx -I../Drivers/Inc -I../Drivers/CMSIS/Include \
+*     -I../Drivers/CMSIS/Device/ST/STM32L4xx/Include \
+*     -I../Drivers/STM32L4xx_HAL_Driver/Inc \
+*     -o spiDMA_encodeBench spiDMA_encodeBench.c && ./spiDMA_encodeBench
+*******************************************************************************/
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <spiDMA_encode.h>    //Encoder of the firmware, pins from board.h
+
+
+/* Defines -------------------------------------------------------------------*/
+#define TX_WORDS_PER_BYTE   SPIDMA_WORDS_PER_BYTE
+#define TEST_BYTES          1024          //Size of the display buffer
+#define ITERATIONS          20000
+
+
+/* Macros --------------------------------------------------------------------*/
+//BSRR words of the former bit loop, built from the pins of board.h
+#define BITMASK_MOSI_SET    ((uint32_t)DISP_MOSI_Pin <<  0)
+#define BITMASK_MOSI_RESET  ((uint32_t)DISP_MOSI_Pin << 16)
+#define BITMASK_SCLK_SET    ((uint32_t)DISP_CLK_Pin <<  0)
+#define BITMASK_SCLK_RESET  ((uint32_t)DISP_CLK_Pin << 16)
+
+
+/* Variables -----------------------------------------------------------------*/
+static uint8_t data[TEST_BYTES];
+static uint32_t wordsBitLoop[TEST_BYTES*TX_WORDS_PER_BYTE];
+static uint32_t wordsTable[TEST_BYTES*TX_WORDS_PER_BYTE];
+
+
+/* Code ----------------------------------------------------------------------*/
+
+/*******************************************************************************
+ * Encodes the bytes with the bit loop used by spiDMA.c before the table.
+ *
+ * @param pData The bytes to encode
+ * @param size Number of bytes
+ * @param pBuffer The DMA words (size*TX_WORDS_PER_BYTE)
+ * @return nothing
+ *******************************************************************************/
+__attribute__((noinline))
+static void encodeBitLoop( const uint8_t* pData, uint32_t size, uint32_t* pBuffer ) {
+  uint32_t buffer_cnt = 0;
+
+  for(uint32_t byte_cnt = 0; byte_cnt < size; byte_cnt++) {
+    for(uint32_t bit_cnt = 0; bit_cnt < 8; bit_cnt++) {
+      if((pData[byte_cnt] & (1 << (7-bit_cnt))) != 0) {
+        pBuffer[buffer_cnt++] = BITMASK_SCLK_RESET | BITMASK_MOSI_SET;
+        pBuffer[buffer_cnt++] = BITMASK_SCLK_SET | BITMASK_MOSI_SET;
+      } else {
+        pBuffer[buffer_cnt++] = BITMASK_SCLK_RESET | BITMASK_MOSI_RESET;
+        pBuffer[buffer_cnt++] = BITMASK_SCLK_SET | BITMASK_MOSI_RESET;
+      }
+    }
+  }
+}
+
+
+/*******************************************************************************
+ * Encodes the bytes with spiDMA_encodeByte() of the firmware.
+ *
+ * @param pData The bytes to encode
+ * @param size Number of bytes
+ * @param pBuffer The DMA words (size*TX_WORDS_PER_BYTE)
+ * @return nothing
+ *******************************************************************************/
+__attribute__((noinline))
+static void encodeTable( const uint8_t* pData, uint32_t size, uint32_t* pBuffer ) {
+  uint32_t buffer_cnt = 0;
+
+  for(uint32_t byte_cnt = 0; byte_cnt < size; byte_cnt++) {
+    spiDMA_encodeByte(pData[byte_cnt], &pBuffer[buffer_cnt]);
+    buffer_cnt += TX_WORDS_PER_BYTE;
+  }
+}
+
+
+/*******************************************************************************
+ * Returns the time of the monotonic clock.
+ *
+ * @return time in ns
+ *******************************************************************************/
+static double getTime( void ) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+/*******************************************************************************
+ * Checks both encodings for all byte values (followed by random bytes) and
+ * measures the time per byte.
+ *
+ * @return 0 if both encodings are bit-identical
+ *******************************************************************************/
+int main( void ) {
+  double start, timeBitLoop, timeTable;
+
+  for(uint32_t i = 0; i < TEST_BYTES; i++) {
+    data[i] = (i < 256) ? i : (uint32_t)rand();
+  }
+
+  //Bit-identical DMA words
+  encodeBitLoop(data, TEST_BYTES, wordsBitLoop);
+  encodeTable(data, TEST_BYTES, wordsTable);
+  if(memcmp(wordsBitLoop, wordsTable, sizeof(wordsTable)) != 0) {
+    printf("MISMATCH: encodings differ\n");
+    return 1;
+  }
+  printf("Bit-identical: all 256 byte values and %d random bytes\n", TEST_BYTES - 256);
+
+  //Time per byte (the barrier keeps the compiler from dropping the loops)
+  start = getTime();
+  for(uint32_t i = 0; i < ITERATIONS; i++) {
+    encodeBitLoop(data, TEST_BYTES, wordsBitLoop);
+    __asm__ volatile("" : : "r"(wordsBitLoop) : "memory");
+  }
+  timeBitLoop = (getTime() - start) / ITERATIONS / TEST_BYTES;
+
+  start = getTime();
+  for(uint32_t i = 0; i < ITERATIONS; i++) {
+    encodeTable(data, TEST_BYTES, wordsTable);
+    __asm__ volatile("" : : "r"(wordsTable) : "memory");
+  }
+  timeTable = (getTime() - start) / ITERATIONS / TEST_BYTES;
+
+  printf("Bit loop:     %.2f ns/byte\n", timeBitLoop);
+  printf("Nibble table: %.2f ns/byte\n", timeTable);
+  return 0;
+}
@@ -11,6 +11,7 @@
 /* ########################### Configuration ############################### */
 //#define USE_DEBUG_UART
 #define ENABLE_WATCHDOG
+#define SYSTEM_CLOCK_MHZ 100   //Clock profile: 16 (HSI), 48 or 100 (PLL)
 
 /* ########################### Output GPIO ################################# */
 #define DO1_Port         GPIOA
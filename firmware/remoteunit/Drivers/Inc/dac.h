@@ -10,6 +10,10 @@
 
 void dac_init(void);
 void dac_setAllChannels(uint16_t ch1_val, uint16_t ch2_val, uint16_t ch3_val, uint16_t ch4_val);
+void dac_refresh(void);
+uint32_t dac_getSkippedWrites(void);
+uint32_t dac_getMaxBurstTime(void);
+void dac_burstCpltCallback(void);
 
 #endif /* _DRIVER_INC_DAC_H */
 
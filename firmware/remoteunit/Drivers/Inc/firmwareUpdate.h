@@ -0,0 +1,59 @@
+/*******************************************************************************
+* @file         : firmwareUpdate.h
+* @project      : 4D-Joystick, Remote-Unit
+* @author       : Fabian Baer
+* @brief        : Firmware update via the link to the joystick-unit
+*******************************************************************************/
+
+#ifndef _DRIVER_INC_FIRMWAREUPDATE_H
+#define _DRIVER_INC_FIRMWAREUPDATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//Flash layout (must match the linker script): The resident bootloader lives in
+//sector 0, the application in sectors 1-3. A new image is received into
+//sector 4 and installed by the bootloader after the next reset.
+#define FWUPDATE_APP_ADDRESS      0x08004000
+#define FWUPDATE_APP_FIRST_SECTOR 1
+#define FWUPDATE_APP_SECTORS      3
+#define FWUPDATE_APP_SIZE         (48*1024)
+#define FWUPDATE_STAGING_ADDRESS  0x08010000
+#define FWUPDATE_STAGING_SECTOR   4
+#define FWUPDATE_HEADER_ADDRESS   (FWUPDATE_STAGING_ADDRESS + FWUPDATE_APP_SIZE)
+
+#define FWUPDATE_MAGIC            0x44505552    //"RUPD"
+#define FWUPDATE_PENDING          0xFFFFFFFF    //Header not installed yet (erased)
+#define FWUPDATE_INSTALLED        0x00000000    //Installed by the bootloader
+#define FWUPDATE_DISCARDED        0x0000FFFF    //Cancelled, never installed
+#define FWUPDATE_BLOCK_SIZE       8             //Bytes of image per frame
+
+//Header behind the staged image, written after the image is complete
+typedef struct {
+  uint32_t magic;
+  uint32_t size;
+  uint32_t crc;         //CRC-32 (IEEE 802.3) of the image
+  uint32_t state;       //FWUPDATE_PENDING, FWUPDATE_INSTALLED or FWUPDATE_DISCARDED
+} FirmwareUpdate_Header_t;
+
+//Status reported to the joystick-unit (must match the joystick-unit)
+typedef enum {
+  FWUPDATE_IDLE = 0,
+  FWUPDATE_RECEIVING,
+  FWUPDATE_DONE,        //Image complete and verified, installed after reset
+  FWUPDATE_ERROR
+} FirmwareUpdate_Status_t;
+
+void firmwareUpdate_begin(uint8_t session, uint32_t size);
+void firmwareUpdate_write(uint32_t block, uint8_t* data);
+void firmwareUpdate_finish(uint32_t crc);
+void firmwareUpdate_cancel(void);
+bool firmwareUpdate_isActive(void);
+FirmwareUpdate_Status_t firmwareUpdate_getStatus(void);
+uint32_t firmwareUpdate_getNextBlock(void);
+uint8_t firmwareUpdate_getSession(void);
+uint32_t firmwareUpdate_getInstalledCrc(void);
+uint32_t firmwareUpdate_crc32(uint32_t crc, const uint8_t* data, uint32_t len);
+
+#endif /* _DRIVER_INC_FIRMWAREUPDATE_H */
+
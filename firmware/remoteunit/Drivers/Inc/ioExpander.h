@@ -11,6 +11,10 @@
 void ioExpander_init(void);
 uint8_t ioExpander_getInputs(void);
 void ioExpander_setOutputs(uint8_t values);
+void ioExpander_refresh(void);
+uint32_t ioExpander_getSkippedWrites(void);
+uint32_t ioExpander_getErrors(void);
+uint32_t ioExpander_getMaxTransferTime(void);
 
 #endif /* _DRIVER_INC_IOEXPANDER_H */
 
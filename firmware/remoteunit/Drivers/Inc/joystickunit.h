@@ -10,14 +10,50 @@
 
 #include <remoteIO.h>
 
+//Length of a frame to/from the joystick-unit: Each analog value (12 bit) carries
+//four digital channels, remaining digital channels are packed in extra bytes.
+//The remote-unit adds the digital channels with edges since the last frame
+//(zero from the joystick-unit).
+//The joystick-unit appends the interest mask (inputs sampled by the remote-unit),
+//the remote-unit sends one statistic per frame in these bytes (id, 24 bit value).
+#define JOY_FRAME_DIGITAL_BYTES   ((REMOTEIO_DIGITAL_CHANNELS - 4*REMOTEIO_ANALOG_CHANNELS + 7) / 8)
+#define JOY_FRAME_EDGE_BYTES      ((REMOTEIO_DIGITAL_CHANNELS + 7) / 8)
+#define JOY_FRAME_INTEREST_BYTES  ((REMOTEIO_ANALOG_CHANNELS + REMOTEIO_DIGITAL_CHANNELS + 7) / 8)
+#define JOY_FRAME_LENGTH          (2*REMOTEIO_ANALOG_CHANNELS + JOY_FRAME_DIGITAL_BYTES + \
+                                   JOY_FRAME_EDGE_BYTES + JOY_FRAME_INTEREST_BYTES + 1)
+
+//Statistics sent to the joystick-unit (must match the joystick-unit)
+typedef enum {
+  JOY_STAT_NONE = 0,
+  JOY_STAT_CYCLE_TIME,      //us, longest cycle (sample, exchange, output)
+  JOY_STAT_INPUTS_TIME,     //us, longest sampling of the inputs
+  JOY_STAT_LINK_TIME,       //us, longest exchange with the joystick-unit
+  JOY_STAT_OUTPUTS_TIME,    //us, longest update of the outputs
+  JOY_STAT_I2C_TIME,        //us, longest I2C transfer (IO-expander)
+  JOY_STAT_DAC_TIME,        //us, longest DAC burst
+  JOY_STAT_LINK_ERRORS,     //Faulty frames since power-up
+  JOY_STAT_I2C_ERRORS,      //I2C errors since power-up
+  JOY_STAT_MISSED_TICKS,    //Missed scheduler ticks since power-up
+  JOY_STAT_RESET_CAUSE,     //Reset flags (RCC_CSR bits 24-31)
+  JOY_STAT_FAILOVERS,       //Failovers to passthrough since power-up
+  JOY_STAT_FAILOVER_TIME,   //us, last valid frame until passthrough (last failover)
+  JOY_STAT_RECOVERY_TIME,   //us, first valid frame until Joystickunit-Mode (last recovery)
+  JOY_STAT_CPU_LOAD,        //Per mille, time not spent sleeping
+  JOY_STAT_COUNT
+} Joystickunit_Stat_t;
+
 typedef enum {
   JOY_STATE_NOT_AVAILABLE,
   JOY_STATE_OK,
-  JOY_STATE_ERROR
+  JOY_STATE_ERROR,
+  JOY_STATE_BUSY,
+  JOY_STATE_UPDATE          //Frame of a firmware update
 } Joystickunit_State_t;
 
 void joystickunit_init(void);
 Joystickunit_State_t joystickunit_communicate( RemoteIO_States_t* in, RemoteIO_States_t* out );
+uint64_t joystickunit_getInterest(void);
+void joystickunit_setStat(Joystickunit_Stat_t stat, uint32_t value);
 
 #endif /* _DRIVER_INC_JOYSTICKUNIT_H */
 
@@ -10,15 +10,35 @@
 
 #include "board.h"
 #include "stm32f4xx_hal.h"
+#include <stdbool.h>
+
+//Channel configuration (must match the configuration of the joystick-unit)
+#define REMOTEIO_ANALOG_CHANNELS    4
+#define REMOTEIO_DIGITAL_CHANNELS   24
+#define REMOTEIO_ANALOG_HIGHRES_BITS 16     //Resolution of oversampled analog inputs
+
+//Interest mask: analog channels first, followed by the digital channels
+#define REMOTEIO_INTEREST_ANALOG(ch)  (1ULL << (ch))
+#define REMOTEIO_INTEREST_DIGITAL(ch) (1ULL << (REMOTEIO_ANALOG_CHANNELS + (ch)))
+#define REMOTEIO_INTEREST_ALL         (~0ULL >> (64 - REMOTEIO_ANALOG_CHANNELS - REMOTEIO_DIGITAL_CHANNELS))
+#define REMOTEIO_INTEREST_DIGITAL_ALL (REMOTEIO_INTEREST_ALL & ~(REMOTEIO_INTEREST_ANALOG(REMOTEIO_ANALOG_CHANNELS) - 1))
+
+//Edge mask: one bit per digital channel
+#define REMOTEIO_EDGE(ch)             (1UL << (ch))
 
 typedef struct {
-  uint32_t analog[4];
-  GPIO_PinState digital[24];
+  uint32_t analog[REMOTEIO_ANALOG_CHANNELS];
+  uint16_t analogHighRes[REMOTEIO_ANALOG_CHANNELS];   //Inputs only, not used for outputs
+  GPIO_PinState digital[REMOTEIO_DIGITAL_CHANNELS];
+  uint32_t digitalEdges;    //Inputs only: channels with an edge since cleared (REMOTEIO_EDGE)
 } RemoteIO_States_t;
 
 void remoteIO_init(void);
-void remoteIO_getStates(RemoteIO_States_t* states);
+void remoteIO_initExternal(void);
+void remoteIO_getStates(RemoteIO_States_t* states, uint64_t interest);
 void remoteIO_setStates(RemoteIO_States_t* states);
+void remoteIO_setAnalogPassthrough(bool enable);
+uint32_t remoteIO_getSavedTransactions(void);
 
 #endif /* _DRIVER_INC_REMOTEIO_H */
 
@@ -0,0 +1,30 @@
+/*******************************************************************************
+* @file         : scheduler.h
+* @project      : 4D-Joystick, Remote-Unit
+* @author       : Fabian Baer
+* @brief        : Cooperative scheduler paced by a hardware timer
+*******************************************************************************/
+
+#ifndef _DRIVER_INC_SCHEDULER_H
+#define _DRIVER_INC_SCHEDULER_H
+
+#include <stdint.h>
+
+#define SCHEDULER_TICK_US   1000    //Period of a scheduler tick
+
+typedef struct {
+  void (*function)(void);
+  uint32_t period;        //Ticks between two executions
+  uint32_t offset;        //Tick of the first execution
+  uint32_t execTime;      //us, duration of the last execution
+  uint32_t maxExecTime;   //us, longest execution
+  uint32_t overruns;      //Executions longer than the period or missed ticks
+  uint32_t nextRun;       //Used by scheduler
+} Scheduler_Job_t;
+
+void scheduler_init(void);
+void scheduler_run(Scheduler_Job_t* jobs, uint32_t numJobs);
+uint32_t scheduler_getMissedTicks(void);
+uint32_t scheduler_getLoad(void);
+
+#endif /* _DRIVER_INC_SCHEDULER_H */
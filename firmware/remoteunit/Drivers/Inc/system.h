@@ -12,15 +12,24 @@
 
 void system_setupClock(void);
 void system_init(void);
+void system_initDebug(void);
 void system_watchdogHandler( void );
 void system_handler(Joystickunit_State_t joyState);
+uint32_t system_getTimerClock(TIM_TypeDef* timer);
+void system_reset(void);
+uint8_t system_getResetCause(void);
 
 #ifdef USE_DEBUG_UART
   UART_HandleTypeDef* system_getUartHandle(void);
   void system_doNotUse_debugMessage(uint8_t* text, uint32_t size);
+  void system_doNotUse_debugValue(uint8_t* text, uint32_t size, uint32_t value);
+  void system_flushDebug(void);
+  uint32_t system_getDebugDrops(void);
   #define system_debugMessage(text) system_doNotUse_debugMessage((uint8_t*)text, sizeof(text))
+  #define system_debugValue(text, value) system_doNotUse_debugValue((uint8_t*)text, sizeof(text), value)
 #else
   #define system_debugMessage(text) (void)text;
+  #define system_debugValue(text, value) (void)text; (void)(value);
 #endif
 
 
@@ -0,0 +1,163 @@
+/*******************************************************************************
+* @file         : bootloader.c
+* @project      : 4D-Joystick, Remote-Unit
+* @author       : Fabian Baer
+* @brief        : Resident bootloader, installs images received by firmwareUpdate
+*******************************************************************************/
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stm32f4xx.h>
+#include <firmwareUpdate.h>
+
+
+/* Defines -------------------------------------------------------------------*/
+//The bootloader lives in sector 0 and is never updated, therefore it must not
+//use anything outside of its sections (no HAL, no library, no constant tables)
+#define BOOT_TEXT           __attribute__((section(".boot_text")))
+#define BOOT_VECTORS        4             //Stack, reset, NMI and hard fault
+#define CRC32_POLYNOMIAL    0xEDB88320    //IEEE 802.3, reflected
+#define FLASH_UNLOCK_KEY1   0x45670123
+#define FLASH_UNLOCK_KEY2   0xCDEF89AB
+#define FLASH_ERRORS        (FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_PGPERR | FLASH_SR_PGSERR)
+#define IWDG_RELOAD_KEY     0xAAAA
+
+
+/* Prototypes ----------------------------------------------------------------*/
+BOOT_TEXT void boot_reset(void);
+static BOOT_TEXT void boot_fault(void);
+static BOOT_TEXT bool boot_install(const FirmwareUpdate_Header_t* header);
+static BOOT_TEXT bool boot_waitFlash(void);
+static BOOT_TEXT uint32_t boot_crc32(const uint8_t* data, uint32_t len);
+
+
+/* Variables -----------------------------------------------------------------*/
+extern uint32_t _estack;
+
+//Vector table used until the application is started
+__attribute__((section(".boot_vector"), used))
+static void (* const boot_vectors[BOOT_VECTORS])(void) = {
+    (void (*)(void))&_estack,
+    boot_reset,
+    boot_fault,
+    boot_fault};
+
+
+/* Code ----------------------------------------------------------------------*/
+
+/*******************************************************************************
+ * Reset handler of the bootloader: Installs a pending image from the staging
+ * area (again, if the last installation was interrupted) and starts the
+ * application.
+ *
+ * @return nothing
+ *******************************************************************************/
+BOOT_TEXT void boot_reset(void) {
+  const FirmwareUpdate_Header_t* header = (const FirmwareUpdate_Header_t*)FWUPDATE_HEADER_ADDRESS;
+  const uint32_t* app = (const uint32_t*)FWUPDATE_APP_ADDRESS;
+
+  if(header->magic == FWUPDATE_MAGIC && header->state == FWUPDATE_PENDING &&
+      header->size > 0 && header->size <= FWUPDATE_APP_SIZE &&
+      boot_crc32((const uint8_t*)FWUPDATE_STAGING_ADDRESS, header->size) == header->crc) {
+    if(!boot_install(header)) {
+      boot_fault();
+    }
+  }
+
+  //Start application (its reset handler initializes the stack pointer)
+  SCB->VTOR = FWUPDATE_APP_ADDRESS;
+  ((void (*)(void))app[1])();
+}
+
+
+/*******************************************************************************
+ * Faults within the bootloader: Reset and try again.
+ *
+ * @return nothing
+ *******************************************************************************/
+static BOOT_TEXT void boot_fault(void) {
+  __DSB();
+  SCB->AIRCR = (0x5FAUL << SCB_AIRCR_VECTKEY_Pos) | SCB_AIRCR_SYSRESETREQ_Msk;
+  __DSB();
+  while(1);
+}
+
+
+/*******************************************************************************
+ * Copies the staged image to the application sectors and verifies it. The
+ * header is marked as installed afterwards (programming zeros needs no erase).
+ *
+ * @param header Header of the staged image
+ * @return true if successful
+ *******************************************************************************/
+static BOOT_TEXT bool boot_install(const FirmwareUpdate_Header_t* header) {
+  const uint32_t* src = (const uint32_t*)FWUPDATE_STAGING_ADDRESS;
+  volatile uint32_t* dst = (volatile uint32_t*)FWUPDATE_APP_ADDRESS;
+  uint32_t words = (header->size + 3) >> 2;
+  bool success = true;
+
+  FLASH->KEYR = FLASH_UNLOCK_KEY1;
+  FLASH->KEYR = FLASH_UNLOCK_KEY2;
+  FLASH->SR = FLASH_ERRORS;
+
+  //Erase application sectors
+  for(uint32_t sector = FWUPDATE_APP_FIRST_SECTOR;
+      sector < FWUPDATE_APP_FIRST_SECTOR + FWUPDATE_APP_SECTORS && success; sector++) {
+    FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_SER | (sector << FLASH_CR_SNB_Pos);
+    FLASH->CR |= FLASH_CR_STRT;
+    success = boot_waitFlash();
+  }
+
+  //Program image
+  for(uint32_t i = 0; i < words && success; i++) {
+    FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_PG;
+    dst[i] = src[i];
+    success = boot_waitFlash();
+  }
+
+  //Verify and mark as installed
+  if(success && boot_crc32((const uint8_t*)FWUPDATE_APP_ADDRESS, header->size) == header->crc) {
+    FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_PG;
+    *(volatile uint32_t*)&header->state = FWUPDATE_INSTALLED;
+    success = boot_waitFlash();
+  } else {
+    success = false;
+  }
+
+  FLASH->CR = FLASH_CR_LOCK;
+  return success;
+}
+
+
+/*******************************************************************************
+ * Waits for the end of a flash operation (refreshes the watchdog, in case it
+ * is started by hardware).
+ *
+ * @return true if no error occurred
+ *******************************************************************************/
+static BOOT_TEXT bool boot_waitFlash(void) {
+  while(FLASH->SR & FLASH_SR_BSY) {
+    IWDG->KR = IWDG_RELOAD_KEY;
+  }
+  return (FLASH->SR & FLASH_ERRORS) == 0;
+}
+
+
+/*******************************************************************************
+ * Calculates the CRC-32 (IEEE 802.3) of data, same as firmwareUpdate_crc32().
+ *
+ * @param data The data
+ * @param len Length of the data
+ * @return CRC-32
+ *******************************************************************************/
+static BOOT_TEXT uint32_t boot_crc32(const uint8_t* data, uint32_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+
+  while(len--) {
+    crc ^= *data++;
+    for(uint32_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? CRC32_POLYNOMIAL : 0);
+    }
+  }
+  return ~crc;
+}
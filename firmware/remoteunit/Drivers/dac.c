@@ -24,11 +24,21 @@
 #define WRITE_ALL_UPDATE    0x2000
 #define POWER_DOWN          0x3000
 
+#define DAC_CHANNELS        4
+#define VALUE_INVALID       0xFFFF    //Value of channel not known
 #define SPI_TIMEOUT_MS      10
+#define SPI_MAX_CLOCK       30000000  //Hz, max. SCLK of DAC (40 MHz) with margin
 
 
 /* Variables -----------------------------------------------------------------*/
 SPI_HandleTypeDef hspi5;
+static volatile uint16_t burst[DAC_CHANNELS];
+static volatile uint32_t burstLength = DAC_CHANNELS;
+static volatile uint32_t burstPos = DAC_CHANNELS;
+static uint16_t lastValues[DAC_CHANNELS] = {VALUE_INVALID, VALUE_INVALID, VALUE_INVALID, VALUE_INVALID};
+static uint32_t skippedWrites = 0;
+static volatile uint32_t burstStart = 0;
+static volatile uint32_t maxBurstCycles = 0;
 
 
 /* Code ----------------------------------------------------------------------*/
@@ -70,58 +80,153 @@ void dac_init(void) {
   hspi5.Init.CLKPhase = SPI_PHASE_1EDGE;
   hspi5.Init.NSS = SPI_NSS_SOFT;
   hspi5.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_2;
+  for(uint32_t div = 2; HAL_RCC_GetPCLK2Freq() / div > SPI_MAX_CLOCK && div < 256; div *= 2) {
+    hspi5.Init.BaudRatePrescaler += SPI_CR1_BR_0;
+  }
   hspi5.Init.FirstBit = SPI_FIRSTBIT_MSB;
   hspi5.Init.TIMode = SPI_TIMODE_DISABLE;
   hspi5.Init.CRCCalculation = SPI_CRCCALCULATION_DISABLE;
   if(HAL_SPI_Init(&hspi5) != HAL_OK) {
     system_debugMessage(DEBUG_PREFIX "Cannot init SPI");
-    NVIC_SystemReset();
+    system_reset();
   }
+
+  //Enable SPI and interrupt (used to chain the words of a burst)
+  __HAL_SPI_ENABLE(&hspi5);
+  NVIC_SetPriority(SPI5_IRQn, 1);
+  NVIC_EnableIRQ(SPI5_IRQn);
 }
 
 
 /*******************************************************************************
- * Write to the DAC channels
+ * Write to the DAC channels. Only the channels, which changed since the last
+ * write, are written as burst in background: All but the last word are
+ * preloaded, the last word updates all outputs simultaneously. The SYNC-pulses
+ * between the words are generated by the SPI interrupt, dac_burstCpltCallback()
+ * is called at the end of the burst.
+ * Called from an interrupt (passthrough), the write is skipped while the
+ * previous burst is running, as the SPI interrupt might not be able to preempt
+ * the caller. The channels are written with the next call.
  *
  * @return nothing
  *******************************************************************************/
 void dac_setAllChannels(uint16_t ch1_val, uint16_t ch2_val, uint16_t ch3_val, uint16_t ch4_val) {
-  uint16_t data;
-
-  //Channel A
-  HAL_GPIO_WritePin(GPIOB, DAC_SYNC_Pin, GPIO_PIN_RESET);
-  data = (ch1_val & 0x0FFF) | WRITE_CH_UPDATE | DAC_A;
-  if(HAL_SPI_Transmit(&hspi5, (uint8_t *)&data, 1, SPI_TIMEOUT_MS) != HAL_OK) {
-    system_debugMessage(DEBUG_PREFIX "Communication error (setAllChannels - A)");
-    NVIC_SystemReset();
+  const uint16_t address[DAC_CHANNELS] = {DAC_A, DAC_B, DAC_C, DAC_D};
+  uint16_t values[DAC_CHANNELS] = {ch1_val & 0x0FFF, ch2_val & 0x0FFF, ch3_val & 0x0FFF, ch4_val & 0x0FFF};
+  uint32_t length = 0;
+  uint32_t start = HAL_GetTick();
+
+  //Skip within an interrupt, if the previous burst is still running
+  if(__get_IPSR() != 0 && burstPos < burstLength) {
+    return;
   }
-  HAL_GPIO_WritePin(GPIOB, DAC_SYNC_Pin, GPIO_PIN_SET);
 
-  //Channel B
-  HAL_GPIO_WritePin(GPIOB, DAC_SYNC_Pin, GPIO_PIN_RESET);
-  data = (ch2_val & 0x0FFF) | WRITE_CH_UPDATE | DAC_B;
-  if(HAL_SPI_Transmit(&hspi5, (uint8_t *)&data, 1, SPI_TIMEOUT_MS) != HAL_OK) {
-    system_debugMessage(DEBUG_PREFIX "Communication error (setAllChannels - B)");
-    NVIC_SystemReset();
+  //Wait for previous burst (takes only a few microseconds). Sleep until the
+  //next interrupt, the interrupts are masked while checking to not miss one.
+  __disable_irq();
+  while(burstPos < burstLength) {
+    if(HAL_GetTick() - start > SPI_TIMEOUT_MS) {
+      __enable_irq();
+      system_debugMessage(DEBUG_PREFIX "Communication error (setAllChannels)");
+      system_reset();
+    }
+    __WFI();
+    __enable_irq();
+    __disable_irq();
   }
-  HAL_GPIO_WritePin(GPIOB, DAC_SYNC_Pin, GPIO_PIN_SET);
+  __enable_irq();
+
+  //Prepare burst of changed channels (WRITE_ALL_UPDATE would write the value
+  //to all channels)
+  for(uint32_t i = 0; i < DAC_CHANNELS; i++) {
+    if(values[i] != lastValues[i]) {
+      burst[length++] = values[i] | WRITE_CH_NO_UPDATE | address[i];
+      lastValues[i] = values[i];
+    }
+  }
+  skippedWrites += DAC_CHANNELS - length;
 
-  //Channel C
-  HAL_GPIO_WritePin(GPIOB, DAC_SYNC_Pin, GPIO_PIN_RESET);
-  data = (ch3_val & 0x0FFF) | WRITE_CH_UPDATE | DAC_C;
-  if(HAL_SPI_Transmit(&hspi5, (uint8_t *)&data, 1, SPI_TIMEOUT_MS) != HAL_OK) {
-    system_debugMessage(DEBUG_PREFIX "Communication error (setAllChannels - C)");
-    NVIC_SystemReset();
+  if(length == 0) {
+    return;
   }
-  HAL_GPIO_WritePin(GPIOB, DAC_SYNC_Pin, GPIO_PIN_SET);
+  burst[length - 1] |= WRITE_CH_UPDATE;
+
+  //Start with first word
+  burstLength = length;
+  burstPos = 0;
+  burstStart = DWT->CYCCNT;
+  HAL_GPIO_WritePin(DAC_SYNC_Port, DAC_SYNC_Pin, GPIO_PIN_RESET);
+  __HAL_SPI_ENABLE_IT(&hspi5, SPI_IT_RXNE);
+  hspi5.Instance->DR = burst[0];
+}
+
 
-  //Channel D
-  HAL_GPIO_WritePin(GPIOB, DAC_SYNC_Pin, GPIO_PIN_RESET);
-  data = (ch4_val & 0x0FFF) | WRITE_CH_UPDATE | DAC_D;
-  if(HAL_SPI_Transmit(&hspi5, (uint8_t *)&data, 1, SPI_TIMEOUT_MS) != HAL_OK) {
-    system_debugMessage(DEBUG_PREFIX "Communication error (setAllChannels - D)");
-    NVIC_SystemReset();
+/*******************************************************************************
+ * Forces the next dac_setAllChannels() to write all channels, even if the
+ * values did not change (guards against corrupted DAC registers).
+ *
+ * @return nothing
+ *******************************************************************************/
+void dac_refresh(void) {
+  for(uint32_t i = 0; i < DAC_CHANNELS; i++) {
+    lastValues[i] = VALUE_INVALID;
   }
-  HAL_GPIO_WritePin(GPIOB, DAC_SYNC_Pin, GPIO_PIN_SET);
+}
+
+
+/*******************************************************************************
+ * Returns the number of channel writes, which were skipped because the channel
+ * already had the value.
+ *
+ * @return skipped writes
+ *******************************************************************************/
+uint32_t dac_getSkippedWrites(void) {
+  return skippedWrites;
+}
 
+
+/*******************************************************************************
+ * Returns the longest burst since the last call.
+ *
+ * @return burst time in us
+ *******************************************************************************/
+uint32_t dac_getMaxBurstTime(void) {
+  uint32_t cycles = maxBurstCycles;
+  maxBurstCycles = 0;
+  return cycles / (SystemCoreClock / 1000000);
+}
+
+
+/*******************************************************************************
+ * Called after all channels of a burst are written.
+ *
+ * @return nothing
+ *******************************************************************************/
+__weak void dac_burstCpltCallback(void) {
+}
+
+
+/*******************************************************************************
+ * SPI interrupt: A word is completely shifted out (RXNE), ends the frame with
+ * SYNC and starts the next word of the burst.
+ *
+ * @return nothing
+ *******************************************************************************/
+void SPI5_IRQHandler(void) {
+  if(__HAL_SPI_GET_FLAG(&hspi5, SPI_FLAG_RXNE)) {
+    (void)hspi5.Instance->DR;
+    DAC_SYNC_Port->BSRR = DAC_SYNC_Pin;
+    burstPos++;
+
+    if(burstPos < burstLength) {
+      DAC_SYNC_Port->BSRR = (uint32_t)DAC_SYNC_Pin << 16;
+      hspi5.Instance->DR = burst[burstPos];
+    } else {
+      __HAL_SPI_DISABLE_IT(&hspi5, SPI_IT_RXNE);
+      if(DWT->CYCCNT - burstStart > maxBurstCycles) {
+        maxBurstCycles = DWT->CYCCNT - burstStart;
+      }
+      dac_burstCpltCallback();
+    }
+  }
 }
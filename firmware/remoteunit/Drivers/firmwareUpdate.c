@@ -0,0 +1,313 @@
+/*******************************************************************************
+* @file         : firmwareUpdate.c
+* @project      : 4D-Joystick, Remote-Unit
+* @author       : Fabian Baer
+* @brief        : Firmware update via the link to the joystick-unit
+*******************************************************************************/
+
+/* Includes ------------------------------------------------------------------*/
+#include <stddef.h>
+#include <stm32f4xx_hal.h>
+#include <board.h>
+#include <system.h>
+#include <firmwareUpdate.h>
+
+
+/* Defines -------------------------------------------------------------------*/
+#define DEBUG_PREFIX        "Update - "
+#define CRC32_POLYNOMIAL    0xEDB88320    //IEEE 802.3, reflected
+#define FLASH_ERRORS        (FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_PGPERR | FLASH_SR_PGSERR)
+#define IWDG_RELOAD_KEY     0xAAAA
+
+//Check if image and header fit into the staging sector (64 KB)
+typedef uint8_t assertStagingSize[(FWUPDATE_APP_SIZE + sizeof(FirmwareUpdate_Header_t) <= 64*1024)*2-1];
+
+//Check if a block consists of complete flash words
+typedef uint8_t assertBlockSize[(FWUPDATE_BLOCK_SIZE % 4 == 0)*2-1];
+
+
+/* Prototypes ----------------------------------------------------------------*/
+static __RAM_FUNC bool firmwareUpdate_eraseStaging(void);
+static bool firmwareUpdate_program(uint32_t address, uint8_t* data, uint32_t len);
+static void firmwareUpdate_flushDataCache(void);
+
+
+/* Variables -----------------------------------------------------------------*/
+static FirmwareUpdate_Status_t status = FWUPDATE_IDLE;
+static uint8_t session = 0;
+static uint32_t imageSize = 0;
+static uint32_t imageCrc = 0;
+static uint32_t nextBlock = 0;
+
+
+/* Code ----------------------------------------------------------------------*/
+
+/*******************************************************************************
+ * Starts receiving a new image and erases the staging area. A repeated request
+ * of the running session (e.g. after a link error) resumes the update.
+ * The erase stalls the controller for about one second (interrupts disabled).
+ *
+ * @param newSession Session of the update (chosen by the joystick-unit)
+ * @param size Size of the image in bytes
+ * @return nothing
+ *******************************************************************************/
+void firmwareUpdate_begin(uint8_t newSession, uint32_t size) {
+  if(status != FWUPDATE_IDLE && newSession == session && size == imageSize) {
+    return;
+  }
+
+  session = newSession;
+  imageSize = size;
+  imageCrc = 0;
+  nextBlock = 0;
+
+  if(size == 0 || size > FWUPDATE_APP_SIZE) {
+    system_debugMessage(DEBUG_PREFIX "Invalid image size");
+    status = FWUPDATE_ERROR;
+    return;
+  }
+
+  system_debugMessage(DEBUG_PREFIX "Erasing staging area");
+  if(!firmwareUpdate_eraseStaging()) {
+    system_debugMessage(DEBUG_PREFIX "Cannot erase staging area");
+    status = FWUPDATE_ERROR;
+    return;
+  }
+  status = FWUPDATE_RECEIVING;
+}
+
+
+/*******************************************************************************
+ * Writes a block of the image to the staging area. Only the next expected
+ * block is accepted, duplicates and gaps are ignored (the joystick-unit resends
+ * from firmwareUpdate_getNextBlock()).
+ *
+ * @param block Number of the block
+ * @param data The block (FWUPDATE_BLOCK_SIZE bytes, padded after the image)
+ * @return nothing
+ *******************************************************************************/
+void firmwareUpdate_write(uint32_t block, uint8_t* data) {
+  uint32_t offset = block * FWUPDATE_BLOCK_SIZE;
+  uint32_t len;
+
+  if(status != FWUPDATE_RECEIVING || block != nextBlock || offset >= imageSize) {
+    return;
+  }
+
+  if(!firmwareUpdate_program(FWUPDATE_STAGING_ADDRESS + offset, data, FWUPDATE_BLOCK_SIZE)) {
+    system_debugMessage(DEBUG_PREFIX "Cannot write block");
+    status = FWUPDATE_ERROR;
+    return;
+  }
+
+  len = imageSize - offset;
+  if(len > FWUPDATE_BLOCK_SIZE) {
+    len = FWUPDATE_BLOCK_SIZE;
+  }
+  imageCrc = firmwareUpdate_crc32(imageCrc, data, len);
+  nextBlock++;
+}
+
+
+/*******************************************************************************
+ * Completes the image: If all blocks were received and the CRC matches, the
+ * header is written, so the bootloader installs the image after the next reset.
+ *
+ * @param crc CRC-32 of the image (calculated by the joystick-unit)
+ * @return nothing
+ *******************************************************************************/
+void firmwareUpdate_finish(uint32_t crc) {
+  FirmwareUpdate_Header_t header;
+
+  if(status != FWUPDATE_RECEIVING) {
+    return;
+  }
+
+  if(nextBlock * FWUPDATE_BLOCK_SIZE < imageSize || crc != imageCrc) {
+    system_debugMessage(DEBUG_PREFIX "Image incomplete or CRC mismatch");
+    status = FWUPDATE_ERROR;
+    return;
+  }
+
+  //Magic last, so an interrupted write never leaves a valid header (state
+  //stays erased = pending)
+  header.magic = FWUPDATE_MAGIC;
+  header.size = imageSize;
+  header.crc = imageCrc;
+  if(!firmwareUpdate_program(FWUPDATE_HEADER_ADDRESS + 4, (uint8_t*)&header.size, 8) ||
+      !firmwareUpdate_program(FWUPDATE_HEADER_ADDRESS, (uint8_t*)&header.magic, 4)) {
+    system_debugMessage(DEBUG_PREFIX "Cannot write header");
+    status = FWUPDATE_ERROR;
+    return;
+  }
+
+  system_debugValue(DEBUG_PREFIX "Image received [bytes]: ", imageSize);
+  status = FWUPDATE_DONE;
+}
+
+
+/*******************************************************************************
+ * Cancels the update (the joystick-unit continues with normal frames). A
+ * completed image is discarded, so it is not installed by the next reset.
+ *
+ * @return nothing
+ *******************************************************************************/
+void firmwareUpdate_cancel(void) {
+  uint32_t discarded = FWUPDATE_DISCARDED;
+
+  if(status == FWUPDATE_DONE) {
+    firmwareUpdate_program(FWUPDATE_HEADER_ADDRESS + offsetof(FirmwareUpdate_Header_t, state),
+        (uint8_t*)&discarded, 4);
+  }
+  if(status != FWUPDATE_IDLE) {
+    system_debugMessage(DEBUG_PREFIX "Update cancelled");
+  }
+  status = FWUPDATE_IDLE;
+}
+
+
+/*******************************************************************************
+ * Returns true while an update is running (the link sends update frames).
+ *
+ * @return true if an update is running
+ *******************************************************************************/
+bool firmwareUpdate_isActive(void) {
+  return status != FWUPDATE_IDLE;
+}
+
+
+/*******************************************************************************
+ * Getters for the status reported to the joystick-unit.
+ *
+ * @return status, next expected block, session
+ *******************************************************************************/
+FirmwareUpdate_Status_t firmwareUpdate_getStatus(void) {
+  return status;
+}
+
+uint32_t firmwareUpdate_getNextBlock(void) {
+  return nextBlock;
+}
+
+uint8_t firmwareUpdate_getSession(void) {
+  return session;
+}
+
+
+/*******************************************************************************
+ * Returns the CRC of the image, which was installed by the bootloader with the
+ * last update. The joystick-unit compares it after the restart to check that
+ * the new image is running.
+ *
+ * @return CRC-32 of the installed image, 0 if no image was installed
+ *******************************************************************************/
+uint32_t firmwareUpdate_getInstalledCrc(void) {
+  const FirmwareUpdate_Header_t* header = (const FirmwareUpdate_Header_t*)FWUPDATE_HEADER_ADDRESS;
+
+  if(header->magic != FWUPDATE_MAGIC || header->state != FWUPDATE_INSTALLED) {
+    return 0;
+  }
+  return header->crc;
+}
+
+
+/*******************************************************************************
+ * Calculates the CRC-32 (IEEE 802.3) of data. Can be chained, start with 0.
+ *
+ * @param crc CRC of the previous data (0 for the first call)
+ * @param data The data
+ * @param len Length of the data
+ * @return CRC-32
+ *******************************************************************************/
+uint32_t firmwareUpdate_crc32(uint32_t crc, const uint8_t* data, uint32_t len) {
+  crc = ~crc;
+  while(len--) {
+    crc ^= *data++;
+    for(uint32_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? CRC32_POLYNOMIAL : 0);
+    }
+  }
+  return ~crc;
+}
+
+
+/*******************************************************************************
+ * Erases the staging sector. Executed from RAM with interrupts disabled, as the
+ * flash (and therefore the interrupt handlers) is stalled during the erase. The
+ * watchdog is refreshed while waiting.
+ *
+ * @return true if successful
+ *******************************************************************************/
+static __RAM_FUNC bool firmwareUpdate_eraseStaging(void) {
+  uint32_t primask = __get_PRIMASK();
+  bool success;
+
+  __disable_irq();
+  FLASH->KEYR = FLASH_KEY1;
+  FLASH->KEYR = FLASH_KEY2;
+  FLASH->SR = FLASH_ERRORS;
+
+  FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_SER | (FWUPDATE_STAGING_SECTOR << FLASH_CR_SNB_Pos);
+  FLASH->CR |= FLASH_CR_STRT;
+  while(FLASH->SR & FLASH_SR_BSY) {
+    IWDG->KR = IWDG_RELOAD_KEY;
+  }
+  success = (FLASH->SR & FLASH_ERRORS) == 0;
+  FLASH->CR = FLASH_CR_LOCK;
+
+  //Data cache might hold lines of the erased sector
+  if(FLASH->ACR & FLASH_ACR_DCEN) {
+    FLASH->ACR &= ~FLASH_ACR_DCEN;
+    FLASH->ACR |= FLASH_ACR_DCRST;
+    FLASH->ACR &= ~FLASH_ACR_DCRST;
+    FLASH->ACR |= FLASH_ACR_DCEN;
+  }
+
+  if(!primask) {
+    __enable_irq();
+  }
+  return success;
+}
+
+
+/*******************************************************************************
+ * Programs data word by word and verifies it (a word takes about 16 us).
+ *
+ * @param address Destination in flash (word aligned)
+ * @param data The data
+ * @param len Length of the data (multiple of 4)
+ * @return true if successful
+ *******************************************************************************/
+static bool firmwareUpdate_program(uint32_t address, uint8_t* data, uint32_t len) {
+  uint32_t word;
+  bool success = true;
+
+  HAL_FLASH_Unlock();
+  for(uint32_t i = 0; i < len && success; i += 4) {
+    word = data[i] | (data[i+1] << 8) | (data[i+2] << 16) | ((uint32_t)data[i+3] << 24);
+    success = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, address + i, word) == HAL_OK;
+  }
+  HAL_FLASH_Lock();
+
+  //Verify (the data cache is not updated by programming)
+  firmwareUpdate_flushDataCache();
+  for(uint32_t i = 0; i < len && success; i++) {
+    success = *(volatile uint8_t*)(address + i) == data[i];
+  }
+
+  return success;
+}
+
+
+/*******************************************************************************
+ * Flushes the flash data cache (if enabled).
+ *
+ * @return nothing
+ *******************************************************************************/
+static void firmwareUpdate_flushDataCache(void) {
+  if(READ_BIT(FLASH->ACR, FLASH_ACR_DCEN)) {
+    __HAL_FLASH_DATA_CACHE_DISABLE();
+    __HAL_FLASH_DATA_CACHE_RESET();
+    __HAL_FLASH_DATA_CACHE_ENABLE();
+  }
+}
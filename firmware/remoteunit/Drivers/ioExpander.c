@@ -9,7 +9,9 @@
 #include <stm32f4xx_hal.h>
 #include <board.h>
 #include <system.h>
+#include <stdbool.h>
 #include <remoteIO.h>
+#include <ioExpander.h>
 
 
 /* Defines -------------------------------------------------------------------*/
@@ -17,6 +19,9 @@
 
 #define I2C_ADDRESS   (uint16_t)0b01000000
 #define I2C_TIMEOUT   10
+#define DMA_TIMEOUT   2       //ms, transfer via DMA not completed (takes about 100 us)
+#define MAX_ERRORS    10      //Consecutive I2C errors until reset
+#define LATCH_INVALID 0xFFFF  //Latch of outputs not known
 
 #define IODIR_A       0x00
 #define IODIR_B       0x01
@@ -36,8 +41,30 @@
 #define WHOLE_BYTE(x)   (x | (x<<1) | (x<<2) | (x<<3) | (x<<4) | (x<<5) | (x<<6) | (x<<7))
 
 
+/* Prototypes ----------------------------------------------------------------*/
+static void ioExpander_startTransfer(void);
+static void ioExpander_checkTimeout(void);
+static inline void ioExpander_measureTransfer(void);
+
+
 /* Variables -----------------------------------------------------------------*/
 I2C_HandleTypeDef hi2c1;
+DMA_HandleTypeDef hdma1_0;
+DMA_HandleTypeDef hdma1_6;
+static volatile bool busy = false;
+static volatile bool readPending = false;
+static volatile bool writePending = false;
+static volatile uint8_t inputs = 0xFF;
+static volatile uint8_t rxData = 0xFF;
+static volatile uint8_t txData = 0;
+static volatile uint8_t newOutputs = 0;
+static volatile uint16_t latch = LATCH_INVALID;
+static volatile uint32_t errorCnt = 0;
+static uint32_t skippedWrites = 0;
+static volatile uint32_t errorTotal = 0;
+static volatile uint32_t transferStart = 0;
+static volatile uint32_t transferTick = 0;
+static volatile uint32_t maxTransferCycles = 0;
 
 
 /* Code ----------------------------------------------------------------------*/
@@ -75,7 +102,7 @@ void ioExpander_init(void) {
   hi2c1.Init.NoStretchMode = I2C_NOSTRETCH_DISABLE;
   if (HAL_I2C_Init(&hi2c1) != HAL_OK) {
     system_debugMessage(DEBUG_PREFIX "Cannot init I2C");
-    NVIC_SystemReset();
+    system_reset();
   }
 
   //Configure outputs
@@ -83,7 +110,7 @@ void ioExpander_init(void) {
   data[1] = WHOLE_BYTE(IODIR_OUT);
   if(HAL_I2C_Master_Transmit(&hi2c1, I2C_ADDRESS, data, 2, I2C_TIMEOUT) != HAL_OK) {
     system_debugMessage(DEBUG_PREFIX "Communication error (1)");
-    NVIC_SystemReset();
+    system_reset();
   }
 
   //Configure inputs
@@ -91,7 +118,7 @@ void ioExpander_init(void) {
   data[1] = WHOLE_BYTE(IODIR_IN);
   if (HAL_I2C_Master_Transmit(&hi2c1, I2C_ADDRESS, data, 2, I2C_TIMEOUT) != HAL_OK) {
     system_debugMessage(DEBUG_PREFIX "Communication error (2)");
-    NVIC_SystemReset();
+    system_reset();
   }
 
   //Enable pullup
@@ -99,48 +126,293 @@ void ioExpander_init(void) {
   data[1] = WHOLE_BYTE(GPPU_EN);
   if (HAL_I2C_Master_Transmit(&hi2c1, I2C_ADDRESS, data, 2, I2C_TIMEOUT) != HAL_OK) {
     system_debugMessage(DEBUG_PREFIX "Communication error (3)");
-    NVIC_SystemReset();
+    system_reset();
+  }
+
+  //Read initial state of inputs
+  data[0] = GPIO_B;
+  if (HAL_I2C_Master_Transmit(&hi2c1, I2C_ADDRESS, data, 1, I2C_TIMEOUT) != HAL_OK ||
+      HAL_I2C_Master_Receive(&hi2c1, I2C_ADDRESS, data, 1, I2C_TIMEOUT) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Communication error (4)");
+    system_reset();
+  }
+  inputs = data[0];
+
+  //Configure DMA (RX: DMA1 stream 0, TX: DMA1 stream 6, both channel 1)
+  __DMA1_CLK_ENABLE();
+
+  hdma1_0.Instance = DMA1_Stream0;
+  hdma1_0.Init.Channel = DMA_CHANNEL_1;
+  hdma1_0.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  hdma1_0.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma1_0.Init.MemInc = DMA_MINC_ENABLE;
+  hdma1_0.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma1_0.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma1_0.Init.Mode = DMA_NORMAL;
+  hdma1_0.Init.Priority = DMA_PRIORITY_LOW;
+  hdma1_0.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  if (HAL_DMA_Init(&hdma1_0) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot init DMA (RX)");
+    system_reset();
+  }
+
+  hdma1_6.Instance = DMA1_Stream6;
+  hdma1_6.Init.Channel = DMA_CHANNEL_1;
+  hdma1_6.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  hdma1_6.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma1_6.Init.MemInc = DMA_MINC_ENABLE;
+  hdma1_6.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma1_6.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma1_6.Init.Mode = DMA_NORMAL;
+  hdma1_6.Init.Priority = DMA_PRIORITY_LOW;
+  hdma1_6.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  if (HAL_DMA_Init(&hdma1_6) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot init DMA (TX)");
+    system_reset();
   }
+
+  __HAL_LINKDMA(&hi2c1, hdmarx, hdma1_0);
+  __HAL_LINKDMA(&hi2c1, hdmatx, hdma1_6);
+  NVIC_SetPriority(DMA1_Stream0_IRQn, 1);
+  NVIC_EnableIRQ(DMA1_Stream0_IRQn);
+  NVIC_SetPriority(DMA1_Stream6_IRQn, 1);
+  NVIC_EnableIRQ(DMA1_Stream6_IRQn);
+  NVIC_SetPriority(I2C1_EV_IRQn, 1);
+  NVIC_EnableIRQ(I2C1_EV_IRQn);
+  NVIC_SetPriority(I2C1_ER_IRQn, 1);
+  NVIC_EnableIRQ(I2C1_ER_IRQn);
 }
 
 
 /*******************************************************************************
- * Writes to the GPIO-expander
+ * Writes to the GPIO-expander (non-blocking). The output latch is only written
+ * if the value differs from the last written value.
  *
  * @param values The value of the ouptut port.
  * @return nothing
  *******************************************************************************/
 void ioExpander_setOutputs(uint8_t values) {
-  uint8_t data[2];
+  ioExpander_checkTimeout();
+  if(values == latch && !writePending) {
+    skippedWrites++;
+    return;
+  }
 
-  data[0] = OLAT_A;
-  data[1] = values;
-  if (HAL_I2C_Master_Transmit(&hi2c1, I2C_ADDRESS, data, 2, I2C_TIMEOUT) != HAL_OK) {
-    system_debugMessage(DEBUG_PREFIX "Communication error (4)");
-    NVIC_SystemReset();
+  newOutputs = values;
+  writePending = true;
+  if(!busy) {
+    ioExpander_startTransfer();
   }
 }
 
 
 /*******************************************************************************
- * Reads from the GPIO-expander
+ * Forces the next ioExpander_setOutputs() to write the output latch, even if
+ * the value did not change (guards against a corrupted latch).
+ *
+ * @return nothing
+ *******************************************************************************/
+void ioExpander_refresh(void) {
+  latch = LATCH_INVALID;
+}
+
+
+/*******************************************************************************
+ * Returns the number of writes, which were skipped because the output latch
+ * already had the value.
+ *
+ * @return skipped writes
+ *******************************************************************************/
+uint32_t ioExpander_getSkippedWrites(void) {
+  return skippedWrites;
+}
+
+
+/*******************************************************************************
+ * Returns the number of I2C errors since power-up.
+ *
+ * @return errors
+ *******************************************************************************/
+uint32_t ioExpander_getErrors(void) {
+  return errorTotal;
+}
+
+
+/*******************************************************************************
+ * Returns the longest I2C transfer since the last call.
+ *
+ * @return transfer time in us
+ *******************************************************************************/
+uint32_t ioExpander_getMaxTransferTime(void) {
+  uint32_t cycles = maxTransferCycles;
+  maxTransferCycles = 0;
+  return cycles / (SystemCoreClock / 1000000);
+}
+
+
+/*******************************************************************************
+ * Reads from the GPIO-expander (non-blocking). Returns the result of the last
+ * read and starts a new read in background.
  *
  * @return The states of the input-port
  *******************************************************************************/
 uint8_t ioExpander_getInputs(void) {
-  uint8_t data;
+  readPending = true;
+  ioExpander_checkTimeout();
+  if(!busy) {
+    ioExpander_startTransfer();
+  }
+
+  return inputs;
+}
+
 
-  data = GPIO_B;
-  if (HAL_I2C_Master_Transmit(&hi2c1, I2C_ADDRESS, &data, 1, I2C_TIMEOUT) != HAL_OK) {
-    system_debugMessage(DEBUG_PREFIX "Communication error (5)");
-    NVIC_SystemReset();
+/*******************************************************************************
+ * Starts the next pending transfer via DMA (writes before reads). Must only be
+ * called if no transfer is running.
+ *
+ * @return nothing
+ *******************************************************************************/
+static void ioExpander_startTransfer(void) {
+  HAL_StatusTypeDef status;
+
+  if(writePending) {
+    busy = true;
+    writePending = false;
+    txData = newOutputs;
+    status = HAL_I2C_Mem_Write_DMA(&hi2c1, I2C_ADDRESS, OLAT_A, I2C_MEMADD_SIZE_8BIT,
+        (uint8_t*)&txData, 1);
+  } else if(readPending) {
+    busy = true;
+    readPending = false;
+    status = HAL_I2C_Mem_Read_DMA(&hi2c1, I2C_ADDRESS, GPIO_B, I2C_MEMADD_SIZE_8BIT,
+        (uint8_t*)&rxData, 1);
+  } else {
+    return;
+  }
+  transferStart = DWT->CYCCNT;
+  transferTick = HAL_GetTick();
+
+  if(status != HAL_OK) {
+    busy = false;
+    latch = LATCH_INVALID;
+    errorTotal++;
+    if(++errorCnt > MAX_ERRORS) {
+      system_debugMessage(DEBUG_PREFIX "Communication error (5)");
+      system_reset();
+    }
+  }
+}
+
+
+/*******************************************************************************
+ * Aborts a transfer, which was not completed within DMA_TIMEOUT (lost callback,
+ * e.g. after a bus glitch), and reports it as error. The HAL aborts only master
+ * transfers (HAL_I2C_Master_Abort_IT() rejects memory transfers), therefore the
+ * DMA is stopped and the I2C peripheral is reset and initialized again.
+ *
+ * @return nothing
+ *******************************************************************************/
+static void ioExpander_checkTimeout(void) {
+  if(!busy || HAL_GetTick() - transferTick <= DMA_TIMEOUT) {
+    return;
+  }
+
+  //No callback while aborting (SysTick keeps running for the DMA abort)
+  NVIC_DisableIRQ(I2C1_EV_IRQn);
+  NVIC_DisableIRQ(I2C1_ER_IRQn);
+  NVIC_DisableIRQ(DMA1_Stream0_IRQn);
+  NVIC_DisableIRQ(DMA1_Stream6_IRQn);
+
+  if(busy) {
+    HAL_DMA_Abort(&hdma1_0);
+    HAL_DMA_Abort(&hdma1_6);
+    SET_BIT(hi2c1.Instance->CR1, I2C_CR1_SWRST);
+    CLEAR_BIT(hi2c1.Instance->CR1, I2C_CR1_SWRST);
+    __HAL_UNLOCK(&hi2c1);
+    HAL_I2C_Init(&hi2c1);
+
+    system_debugMessage(DEBUG_PREFIX "Transfer timeout");
+    HAL_I2C_ErrorCallback(&hi2c1);
   }
 
-  if (HAL_I2C_Master_Receive(&hi2c1, I2C_ADDRESS, &data, 1, I2C_TIMEOUT) != HAL_OK) {
+  NVIC_ClearPendingIRQ(I2C1_EV_IRQn);
+  NVIC_ClearPendingIRQ(I2C1_ER_IRQn);
+  NVIC_ClearPendingIRQ(DMA1_Stream0_IRQn);
+  NVIC_ClearPendingIRQ(DMA1_Stream6_IRQn);
+  NVIC_EnableIRQ(I2C1_EV_IRQn);
+  NVIC_EnableIRQ(I2C1_ER_IRQn);
+  NVIC_EnableIRQ(DMA1_Stream0_IRQn);
+  NVIC_EnableIRQ(DMA1_Stream6_IRQn);
+}
+
+
+/*******************************************************************************
+ * Updates the longest transfer time with the transfer just finished.
+ *
+ * @return nothing
+ *******************************************************************************/
+static inline void ioExpander_measureTransfer(void) {
+  uint32_t cycles = DWT->CYCCNT - transferStart;
+
+  if(cycles > maxTransferCycles) {
+    maxTransferCycles = cycles;
+  }
+}
+
+
+/*******************************************************************************
+ * I2C callbacks (completion of a transfer). The next pending transfer is
+ * started immediately.
+ *
+ * @return nothing
+ *******************************************************************************/
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c) {
+  ioExpander_measureTransfer();
+  latch = txData;
+  errorCnt = 0;
+  busy = false;
+  ioExpander_startTransfer();
+}
+
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+  ioExpander_measureTransfer();
+  inputs = rxData;
+  errorCnt = 0;
+  busy = false;
+  ioExpander_startTransfer();
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+  //Output latch is unknown after an error (write again)
+  latch = LATCH_INVALID;
+  busy = false;
+  errorTotal++;
+
+  if(++errorCnt > MAX_ERRORS) {
     system_debugMessage(DEBUG_PREFIX "Communication error (6)");
-    NVIC_SystemReset();
+    system_reset();
   }
+}
+
 
-  return data;
+/*******************************************************************************
+ * Interrupts of I2C and DMA (forward to HAL).
+ *
+ * @return nothing
+ *******************************************************************************/
+void I2C1_EV_IRQHandler(void) {
+  HAL_I2C_EV_IRQHandler(&hi2c1);
 }
 
+void I2C1_ER_IRQHandler(void) {
+  HAL_I2C_ER_IRQHandler(&hi2c1);
+}
+
+void DMA1_Stream0_IRQHandler(void) {
+  HAL_DMA_IRQHandler(&hdma1_0);
+}
+
+void DMA1_Stream6_IRQHandler(void) {
+  HAL_DMA_IRQHandler(&hdma1_6);
+}
@@ -11,12 +11,29 @@
 #include <board.h>
 #include <system.h>
 #include <joystickunit.h>
+#include <firmwareUpdate.h>
 #include <remoteIO.h>
 
 
 /* Defines -------------------------------------------------------------------*/
 #define DEBUG_PREFIX        "Joyunit - "
 #define CRC_START_VALUE     0xA5
+#define CRC_UPDATE_START    0x5A    //Frames of a firmware update
+#define LINK_DEADLINE_US    10000   //Window for a valid frame (TIM11, max. 65535)
+#define STAT_MAX_VALUE      0xFFFFFF
+
+//Firmware update frames: The joystick-unit sends command, session, block
+//(16 bit) and data, the remote-unit answers with status, session and the next
+//expected block (the answer lags one frame, as frames are preloaded). Both
+//use CRC_UPDATE_START and carry UPDATE_MARKER in front of the CRC.
+#define UPDATE_CMD_STATUS   0x00    //No data, only requests the status
+#define UPDATE_CMD_BEGIN    0x01    //Data: image size (32 bit)
+#define UPDATE_CMD_DATA     0x02    //Data: FWUPDATE_BLOCK_SIZE bytes of the image
+#define UPDATE_CMD_END      0x03    //Data: CRC-32 of the image
+#define UPDATE_CMD_REBOOT   0x04    //Reset to install the image
+#define UPDATE_POS_DATA     4
+#define UPDATE_POS_MARKER   (JOY_FRAME_LENGTH - 2)
+#define UPDATE_MARKER       0x55    //Guards against corrupted frames with a matching CRC
 
 
 /* Makros --------------------------------------------------------------------*/
@@ -24,16 +41,57 @@
 #define EXTRACT_GPIO_VAL(data, bitnum)  ((data & (1<<bitnum)) ? GPIO_PIN_SET : GPIO_PIN_RESET)
 
 
+/* Typedefs ------------------------------------------------------------------*/
+//Check if the digital channels fill the high nibbles of the analog values
+typedef uint8_t assertFrameLayout[(REMOTEIO_DIGITAL_CHANNELS >= 4*REMOTEIO_ANALOG_CHANNELS)*2-1];
+
+//Check if all channels fit into the interest mask (uint64_t)
+typedef uint8_t assertInterestSize[(REMOTEIO_ANALOG_CHANNELS + REMOTEIO_DIGITAL_CHANNELS >= 1 &&
+                                    REMOTEIO_ANALOG_CHANNELS + REMOTEIO_DIGITAL_CHANNELS <= 64)*2-1];
+
+//Check if a statistic (id and 24 bit value) fits into the interest bytes
+typedef uint8_t assertStatSize[(JOY_FRAME_INTEREST_BYTES >= 4)*2-1];
+
+//Check if a block of a firmware update fits into a frame
+typedef uint8_t assertUpdateBlock[(UPDATE_POS_DATA + FWUPDATE_BLOCK_SIZE <= UPDATE_POS_MARKER)*2-1];
+
+//Check if the deadline fits into the 16 bit timer
+typedef uint8_t assertDeadline[(LINK_DEADLINE_US > 0 && LINK_DEADLINE_US <= 65535)*2-1];
+
+
+typedef enum {
+  JOY_TRANSFER_IDLE,
+  JOY_TRANSFER_BUSY,
+  JOY_TRANSFER_DONE,
+  JOY_TRANSFER_ERROR
+} Joystickunit_Transfer_t;
+
+
 /* Prototypes ----------------------------------------------------------------*/
-static inline HAL_StatusTypeDef joystickunit_spiRxTx(uint8_t* rx, uint8_t* tx, uint8_t len, uint8_t timeout);
+static void joystickunit_resetSPI(void);
+static inline void joystickunit_restartDeadline(void);
 static inline void joystickunit_packData(RemoteIO_States_t* data, uint8_t* package);
 static inline void joystickunit_unpackData(RemoteIO_States_t* data, uint8_t* package);
-static uint8_t joystickunit_calcCRC(uint8_t* data, uint32_t len);
-static inline bool joystickunit_checkCRC(uint8_t* data, uint32_t len);
+static inline void joystickunit_packUpdate(uint8_t* package);
+static inline void joystickunit_handleUpdate(uint8_t* package);
+static uint8_t joystickunit_calcCRC(uint8_t start, uint8_t* data, uint32_t len);
+static inline bool joystickunit_checkCRC(uint8_t start, uint8_t* data, uint32_t len);
 
 
 /* Variables -----------------------------------------------------------------*/
 SPI_HandleTypeDef hspi1;
+DMA_HandleTypeDef hdma2_2;
+DMA_HandleTypeDef hdma2_3;
+TIM_HandleTypeDef htim11;
+static volatile Joystickunit_Transfer_t transferState = JOY_TRANSFER_IDLE;
+static bool linkActive = false;
+static volatile bool deadlineExpired = false;
+static uint8_t rxData[JOY_FRAME_LENGTH];
+static uint8_t txData[JOY_FRAME_LENGTH];
+static uint64_t interest = REMOTEIO_INTEREST_ALL;
+static uint32_t stats[JOY_STAT_COUNT] = {0};
+static uint32_t statSent = JOY_STAT_NONE;
+static bool updateFrames = false;       //Last frame was a frame of a firmware update
 static uint8_t const crc8_table[] =   { 0x00, 0x31, 0x62, 0x53, 0xc4, 0xf5,
     0xa6, 0x97, 0xb9, 0x88, 0xdb, 0xea, 0x7d, 0x4c, 0x1f, 0x2e, 0x43, 0x72,
     0x21, 0x10, 0x87, 0xb6, 0xe5, 0xd4, 0xfa, 0xcb, 0x98, 0xa9, 0x3e, 0x0f,
@@ -61,223 +119,468 @@ static uint8_t const crc8_table[] =   { 0x00, 0x31, 0x62, 0x53, 0xc4, 0xf5,
 /* Code ----------------------------------------------------------------------*/
 
 /*******************************************************************************
- * Initializes CS-Pin of joystickunit
+ * Initializes SPI1 as slave (hardware NSS) with RX/TX-DMA for the joystickunit
  *
  * @return nothing
  *******************************************************************************/
 void joystickunit_init(void) {
   GPIO_InitTypeDef GPIO_InitStruct = {0};
 
+  //Enable peripherals
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  __HAL_RCC_SPI1_CLK_ENABLE();
+  __DMA2_CLK_ENABLE();
+
   //Init SPI-Pins
-  GPIO_InitStruct.Pin = RJ12_SCK_Pin | RJ12_MOSI_Pin | RJ12_CS_Pin;
-  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+  GPIO_InitStruct.Pin = RJ12_CS_Pin | RJ12_SCK_Pin | RJ12_MISO_Pin | RJ12_MOSI_Pin;
+  GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
   GPIO_InitStruct.Pull = GPIO_NOPULL;
   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+  GPIO_InitStruct.Alternate = GPIO_AF5_SPI1;
   HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
-  GPIO_InitStruct.Pin = RJ12_MISO_Pin;
-  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
-  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+  //Init SPI
+  hspi1.Instance = SPI1;
+  hspi1.Init.Mode = SPI_MODE_SLAVE;
+  hspi1.Init.Direction = SPI_DIRECTION_2LINES;
+  hspi1.Init.DataSize = SPI_DATASIZE_8BIT;
+  hspi1.Init.CLKPolarity = SPI_POLARITY_LOW;
+  hspi1.Init.CLKPhase = SPI_PHASE_1EDGE;
+  hspi1.Init.NSS = SPI_NSS_HARD_INPUT;
+  hspi1.Init.FirstBit = SPI_FIRSTBIT_LSB;
+  hspi1.Init.TIMode = SPI_TIMODE_DISABLE;
+  hspi1.Init.CRCCalculation = SPI_CRCCALCULATION_DISABLE;
+  if(HAL_SPI_Init(&hspi1) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot init SPI");
+    system_reset();
+  }
+
+  //Configure DMA (RX: stream 2, TX: stream 3, both channel 3)
+  hdma2_2.Instance = DMA2_Stream2;
+  hdma2_2.Init.Channel = DMA_CHANNEL_3;
+  hdma2_2.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  hdma2_2.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma2_2.Init.MemInc = DMA_MINC_ENABLE;
+  hdma2_2.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma2_2.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma2_2.Init.Mode = DMA_NORMAL;
+  hdma2_2.Init.Priority = DMA_PRIORITY_VERY_HIGH;
+  hdma2_2.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  if(HAL_DMA_Init(&hdma2_2) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot init DMA (RX)");
+    system_reset();
+  }
+
+  hdma2_3.Instance = DMA2_Stream3;
+  hdma2_3.Init.Channel = DMA_CHANNEL_3;
+  hdma2_3.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  hdma2_3.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma2_3.Init.MemInc = DMA_MINC_ENABLE;
+  hdma2_3.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma2_3.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma2_3.Init.Mode = DMA_NORMAL;
+  hdma2_3.Init.Priority = DMA_PRIORITY_VERY_HIGH;
+  hdma2_3.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  if(HAL_DMA_Init(&hdma2_3) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot init DMA (TX)");
+    system_reset();
+  }
+
+  __HAL_LINKDMA(&hspi1, hdmarx, hdma2_2);
+  __HAL_LINKDMA(&hspi1, hdmatx, hdma2_3);
+  NVIC_SetPriority(DMA2_Stream2_IRQn, 0);
+  NVIC_EnableIRQ(DMA2_Stream2_IRQn);
+  NVIC_SetPriority(DMA2_Stream3_IRQn, 0);
+  NVIC_EnableIRQ(DMA2_Stream3_IRQn);
+
+  //Init deadline timer (1 MHz, one-pulse, restarted with each valid frame)
+  __HAL_RCC_TIM11_CLK_ENABLE();
+
+  htim11.Instance = TIM11;
+  htim11.Init.Prescaler = (system_getTimerClock(TIM11) / 1000000) - 1;
+  htim11.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim11.Init.Period = LINK_DEADLINE_US - 1;
+  htim11.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim11.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if(HAL_TIM_Base_Init(&htim11) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot init deadline timer");
+    system_reset();
+  }
+  htim11.Instance->CR1 |= TIM_CR1_OPM;
+  __HAL_TIM_CLEAR_FLAG(&htim11, TIM_FLAG_UPDATE);
+  __HAL_TIM_ENABLE_IT(&htim11, TIM_IT_UPDATE);
+
+  NVIC_SetPriority(TIM1_TRG_COM_TIM11_IRQn, 1);
+  NVIC_EnableIRQ(TIM1_TRG_COM_TIM11_IRQn);
 }
 
 
 /*******************************************************************************
- * Communciates with Joystickunit.
+ * Communciates with Joystickunit (non-blocking). The frame is preloaded before
+ * the joystickunit starts the transfer, so the slave answers at any clock rate.
+ * After a frame is finished, the next frame is preloaded with the current
+ * inputs. Must be called periodically.
+ * If no valid frame is received within LINK_DEADLINE_US (supervised by TIM11),
+ * the link is stopped and JOY_STATE_NOT_AVAILABLE is returned. The next call
+ * starts the link again.
  *
- * @return nothing
+ * @param in The inputs, which are sent with the next frame
+ * @param out The outputs, which are filled if a valid frame was received
+ * @return JOY_STATE_BUSY if no frame was finished since the last call
  *******************************************************************************/
 Joystickunit_State_t joystickunit_communicate( RemoteIO_States_t* in, RemoteIO_States_t* out ) {
-  uint8_t rxData[10], txData[10];
-  HAL_StatusTypeDef comState;
-
-  //Prepare the data to send
-  joystickunit_packData(in, txData);
-
-  //Transmit the data
-  comState = joystickunit_spiRxTx(rxData, txData, 10, 10);
-  if(comState == HAL_TIMEOUT) {
-    return JOY_STATE_NOT_AVAILABLE;
-  } else if (comState != HAL_OK) {
-    return JOY_STATE_ERROR;
+  Joystickunit_State_t state = JOY_STATE_BUSY;
+
+  //Start deadline supervision with the first call
+  if(!linkActive) {
+    linkActive = true;
+    joystickunit_restartDeadline();
   }
 
-  //Check received data
-  if(joystickunit_checkCRC(rxData, 9)) {
-    joystickunit_unpackData(out, rxData);
-    return JOY_STATE_OK;
-  } else {
-    return JOY_STATE_ERROR;
+  switch(transferState) {
+    case JOY_TRANSFER_DONE:
+      //Check received data (normal frame or frame of a firmware update)
+      if(joystickunit_checkCRC(CRC_START_VALUE, rxData, JOY_FRAME_LENGTH-1)) {
+        updateFrames = false;
+        firmwareUpdate_cancel();
+        joystickunit_unpackData(out, rxData);
+        joystickunit_restartDeadline();
+        state = JOY_STATE_OK;
+      } else if(joystickunit_checkCRC(CRC_UPDATE_START, rxData, JOY_FRAME_LENGTH-1) &&
+          rxData[UPDATE_POS_MARKER] == UPDATE_MARKER) {
+        updateFrames = true;
+        joystickunit_handleUpdate(rxData);
+        joystickunit_restartDeadline();
+        state = JOY_STATE_UPDATE;
+      } else {
+        state = JOY_STATE_ERROR;
+      }
+      transferState = JOY_TRANSFER_IDLE;
+      break;
+
+    case JOY_TRANSFER_ERROR:
+      joystickunit_resetSPI();
+      state = JOY_STATE_ERROR;
+      break;
+
+    case JOY_TRANSFER_BUSY:
+      //CS pin got high within a frame (some, but not all bytes received)
+      if((GPIOA->IDR & RJ12_CS_Pin) && __HAL_DMA_GET_COUNTER(hspi1.hdmarx) > 0 &&
+          __HAL_DMA_GET_COUNTER(hspi1.hdmarx) < JOY_FRAME_LENGTH) {
+        joystickunit_resetSPI();
+        state = JOY_STATE_ERROR;
+      }
+      break;
+
+    case JOY_TRANSFER_IDLE:
+    default:
+      break;
+  }
+
+  //Preload next frame (do not start within a frame)
+  if(transferState == JOY_TRANSFER_IDLE && (GPIOA->IDR & RJ12_CS_Pin)) {
+    if(firmwareUpdate_isActive() || updateFrames) {
+      joystickunit_packUpdate(txData);
+    } else {
+      joystickunit_packData(in, txData);
+    }
+    transferState = JOY_TRANSFER_BUSY;
+    if(HAL_SPI_TransmitReceive_DMA(&hspi1, txData, rxData, JOY_FRAME_LENGTH) != HAL_OK) {
+      joystickunit_resetSPI();
+      state = JOY_STATE_ERROR;
+    }
   }
+
+  //No valid frame within deadline
+  if(state != JOY_STATE_OK && deadlineExpired) {
+    joystickunit_resetSPI();
+    linkActive = false;
+    state = JOY_STATE_NOT_AVAILABLE;
+  }
+
+  return state;
 }
 
 
+/*******************************************************************************
+ * Returns the inputs, which are needed by the joystick-unit (received with the
+ * last valid frame). All inputs are needed until the first frame is received.
+ *
+ * @return The interest mask (REMOTEIO_INTEREST_x)
+ *******************************************************************************/
+uint64_t joystickunit_getInterest(void) {
+  return interest;
+}
+
 
 /*******************************************************************************
- * Handles communication with joystickunit via bitbanging-SPI.
+ * Sets a statistic, which is sent to the joystick-unit. The statistics are sent
+ * in rotation, one per frame.
  *
- * @param rx A pointer to the receiving data array
- * @param tx A pointer to the transmitting data array
- * @param len The amount of data
- * @param timeout The timeout in Millisecons
- * @return The status of the communcation
+ * @param stat The statistic
+ * @param value The value (saturated to 24 bit)
+ * @return nothing
  *******************************************************************************/
-static inline HAL_StatusTypeDef joystickunit_spiRxTx(uint8_t* rx, uint8_t* tx, uint8_t len, uint8_t timeout) {
-  uint32_t time = HAL_GetTick() + timeout;
-  uint16_t curByte, curBit;
+void joystickunit_setStat(Joystickunit_Stat_t stat, uint32_t value) {
+  if(stat > JOY_STAT_NONE && stat < JOY_STAT_COUNT) {
+    stats[stat] = (value > STAT_MAX_VALUE) ? STAT_MAX_VALUE : value;
+  }
+}
+
 
-  //Init RX-data
-  for(curByte = 0; curByte < len; curByte++) {
-    rx[curByte] = 0;
+/*******************************************************************************
+ * Aborts a transfer and resets SPI1. Needed to resynchronize the shift register
+ * after an incomplete frame.
+ *
+ * @return nothing
+ *******************************************************************************/
+static void joystickunit_resetSPI(void) {
+  HAL_SPI_Abort(&hspi1);
+  __HAL_RCC_SPI1_FORCE_RESET();
+  __HAL_RCC_SPI1_RELEASE_RESET();
+  if(HAL_SPI_Init(&hspi1) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot init SPI");
+    system_reset();
   }
+  transferState = JOY_TRANSFER_IDLE;
+}
+
+
+/*******************************************************************************
+ * Restarts the deadline for the next valid frame.
+ *
+ * @return nothing
+ *******************************************************************************/
+static inline void joystickunit_restartDeadline(void) {
+  __HAL_TIM_DISABLE(&htim11);
+  __HAL_TIM_SET_COUNTER(&htim11, 0);
+  deadlineExpired = false;
+  __HAL_TIM_ENABLE(&htim11);
+}
 
-  //Wait for CS pin to get low
-  while(GPIOA->IDR & RJ12_CS_Pin) {
-    if(HAL_GetTick() > time)  return HAL_TIMEOUT;
+
+/*******************************************************************************
+ * Deadline timer expired (no valid frame within LINK_DEADLINE_US).
+ *
+ * @return nothing
+ *******************************************************************************/
+void TIM1_TRG_COM_TIM11_IRQHandler(void) {
+  if(__HAL_TIM_GET_FLAG(&htim11, TIM_FLAG_UPDATE) != RESET) {
+    __HAL_TIM_CLEAR_FLAG(&htim11, TIM_FLAG_UPDATE);
+    deadlineExpired = true;
   }
+}
 
-  //Main transmission
-  for(curByte = 0; curByte < len; curByte++) {
-    for(curBit = 1; curBit <= 0x80; curBit = (curBit << 1)) {
-      //Wait for falling edge on SCK
-      while(GPIOA->IDR & RJ12_SCK_Pin) {
-        if(HAL_GetTick() > time)      {
-          return HAL_TIMEOUT;
-        }
-        if(GPIOA->IDR & RJ12_CS_Pin)  {
-          return HAL_ERROR;
-        }
-      }
 
-      //Set output data
-      GPIOA->BSRR = (tx[curByte] & curBit) ? (RJ12_MISO_Pin) : (RJ12_MISO_Pin << 16);
-
-      //Wait for rising edge on SCK
-      while(!(GPIOA->IDR & RJ12_SCK_Pin)) {
-        if(HAL_GetTick() > time)      {
-          return HAL_TIMEOUT;
-        }
-        if(GPIOA->IDR & RJ12_CS_Pin)  {
-          return HAL_ERROR;
-        }
-      }
+/*******************************************************************************
+ * SPI callbacks (completion event of a frame)
+ *
+ * @return nothing
+ *******************************************************************************/
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
+  if(hspi == &hspi1) {
+    transferState = JOY_TRANSFER_DONE;
+  }
+}
 
-      //Read input
-      rx[curByte] |= (GPIOA->IDR & RJ12_MOSI_Pin) ? curBit : 0;
-    }
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+  if(hspi == &hspi1) {
+    transferState = JOY_TRANSFER_ERROR;
   }
+}
+
 
-  return HAL_OK;
+/*******************************************************************************
+ * DMA interrupts of SPI1 (forward to HAL).
+ *
+ * @return nothing
+ *******************************************************************************/
+void DMA2_Stream2_IRQHandler(void) {
+  HAL_DMA_IRQHandler(&hdma2_2);
+}
+
+void DMA2_Stream3_IRQHandler(void) {
+  HAL_DMA_IRQHandler(&hdma2_3);
 }
 
 
 
 /*******************************************************************************
- * Packs an IO-struct into a format, which can be sent to the remote-unit.
+ * Packs an IO-struct into a format, which can be sent to the joystick-unit. Each
+ * analog value (12 bit) carries four digital channels in its upper nibble, the
+ * remaining digital channels are packed into the following bytes, followed by
+ * the digital channels with edges since the last frame (cleared afterwards).
+ * The bytes of the interest mask carry the next statistic (id, 24 bit value
+ * little-endian).
  *
  * @param pData The data (IO-struct) which will be used to create the package.
- * @param pPackage The package which will be filled with data (uint8_t x[10])
+ * @param pPackage The package which will be filled with data (uint8_t x[JOY_FRAME_LENGTH])
  * @return nothing
  *******************************************************************************/
 static inline void joystickunit_packData(RemoteIO_States_t* data, uint8_t* package) {
-  package[0]  = (data->analog[0] >> 0) & 0xFF;
-  package[1]  = (data->analog[0] >> 8) & 0x0F;
-  package[1] |= ADD_GPIO_BIT(data->digital[ 0], 4);
-  package[1] |= ADD_GPIO_BIT(data->digital[ 1], 5);
-  package[1] |= ADD_GPIO_BIT(data->digital[ 2], 6);
-  package[1] |= ADD_GPIO_BIT(data->digital[ 3], 7);
-
-  package[2]  = (data->analog[1] >> 0) & 0xFF;
-  package[3]  = (data->analog[1] >> 8) & 0x0F;
-  package[3] |= ADD_GPIO_BIT(data->digital[ 4], 4);
-  package[3] |= ADD_GPIO_BIT(data->digital[ 5], 5);
-  package[3] |= ADD_GPIO_BIT(data->digital[ 6], 6);
-  package[3] |= ADD_GPIO_BIT(data->digital[ 7], 7);
-
-  package[4]  = (data->analog[2] >> 0) & 0xFF;
-  package[5]  = (data->analog[2] >> 8) & 0x0F;
-  package[5] |= ADD_GPIO_BIT(data->digital[ 8], 4);
-  package[5] |= ADD_GPIO_BIT(data->digital[ 9], 5);
-  package[5] |= ADD_GPIO_BIT(data->digital[10], 6);
-  package[5] |= ADD_GPIO_BIT(data->digital[11], 7);
-
-  package[6]  = (data->analog[3] >> 0) & 0xFF;
-  package[7]  = (data->analog[3] >> 8) & 0x0F;
-  package[7] |= ADD_GPIO_BIT(data->digital[12], 4);
-  package[7] |= ADD_GPIO_BIT(data->digital[13], 5);
-  package[7] |= ADD_GPIO_BIT(data->digital[14], 6);
-  package[7] |= ADD_GPIO_BIT(data->digital[15], 7);
-
-  package[8]  = ADD_GPIO_BIT(data->digital[16], 0);
-  package[8] |= ADD_GPIO_BIT(data->digital[17], 1);
-  package[8] |= ADD_GPIO_BIT(data->digital[18], 2);
-  package[8] |= ADD_GPIO_BIT(data->digital[19], 3);
-  package[8] |= ADD_GPIO_BIT(data->digital[20], 4);
-  package[8] |= ADD_GPIO_BIT(data->digital[21], 5);
-  package[8] |= ADD_GPIO_BIT(data->digital[22], 6);
-  package[8] |= ADD_GPIO_BIT(data->digital[23], 7);
-
-  package[9] = joystickunit_calcCRC(package, 9);
+  uint32_t ch = 0;
+  uint32_t pos = 0;
+
+  //Analog values incl. four digital channels
+  for(uint32_t i = 0; i < REMOTEIO_ANALOG_CHANNELS; i++) {
+    package[pos++] = (data->analog[i] >> 0) & 0xFF;
+    package[pos]   = (data->analog[i] >> 8) & 0x0F;
+    for(uint32_t bit = 4; bit < 8; bit++) {
+      package[pos] |= ADD_GPIO_BIT(data->digital[ch++], bit);
+    }
+    pos++;
+  }
+
+  //Remaining digital channels
+  for(uint32_t i = 0; i < JOY_FRAME_DIGITAL_BYTES; i++) {
+    package[pos] = 0;
+    for(uint32_t bit = 0; bit < 8 && ch < REMOTEIO_DIGITAL_CHANNELS; bit++) {
+      package[pos] |= ADD_GPIO_BIT(data->digital[ch++], bit);
+    }
+    pos++;
+  }
+
+  //Edges since the last frame
+  for(uint32_t i = 0; i < JOY_FRAME_EDGE_BYTES; i++) {
+    package[pos++] = (data->digitalEdges >> (8*i)) & 0xFF;
+  }
+  data->digitalEdges = 0;
+
+  //Next statistic instead of interest mask
+  statSent = (statSent % (JOY_STAT_COUNT - 1)) + 1;
+  package[pos++] = statSent;
+  package[pos++] = (stats[statSent] >> 0) & 0xFF;
+  package[pos++] = (stats[statSent] >> 8) & 0xFF;
+  package[pos++] = (stats[statSent] >> 16) & 0xFF;
+  for(uint32_t i = 4; i < JOY_FRAME_INTEREST_BYTES; i++) {
+    package[pos++] = 0;
+  }
+
+  package[pos] = joystickunit_calcCRC(CRC_START_VALUE, package, pos);
 }
 
 
 /*******************************************************************************
- * Unpacks a package received from the remote-unit and stores its contents to
- * the IO-struct.
+ * Unpacks a package received from the joystick-unit and stores its contents to
+ * the IO-struct. The interest mask is stored for joystickunit_getInterest().
  *
  * @param pData A pointer to the IO-struct which will be filled.
- * @param pPackage The package received from the remote-unit (uint8_t x[10])
+ * @param pPackage The package received from the joystick-unit (uint8_t x[JOY_FRAME_LENGTH])
  * @return nothing
  *******************************************************************************/
 static inline void joystickunit_unpackData(RemoteIO_States_t* data, uint8_t* package) {
-  //Convert analog
-  data->analog[0] = package[0] | ((package[1] & 0x0F) << 8);
-  data->analog[1] = package[2] | ((package[3] & 0x0F) << 8);
-  data->analog[2] = package[4] | ((package[5] & 0x0F) << 8);
-  data->analog[3] = package[6] | ((package[7] & 0x0F) << 8);
-
-  //Convert digital
-  data->digital[ 0] = EXTRACT_GPIO_VAL(package[1], 4);
-  data->digital[ 1] = EXTRACT_GPIO_VAL(package[1], 5);
-  data->digital[ 2] = EXTRACT_GPIO_VAL(package[1], 6);
-  data->digital[ 3] = EXTRACT_GPIO_VAL(package[1], 7);
-
-  data->digital[ 4] = EXTRACT_GPIO_VAL(package[3], 4);
-  data->digital[ 5] = EXTRACT_GPIO_VAL(package[3], 5);
-  data->digital[ 6] = EXTRACT_GPIO_VAL(package[3], 6);
-  data->digital[ 7] = EXTRACT_GPIO_VAL(package[3], 7);
-
-  data->digital[ 8] = EXTRACT_GPIO_VAL(package[5], 4);
-  data->digital[ 9] = EXTRACT_GPIO_VAL(package[5], 5);
-  data->digital[10] = EXTRACT_GPIO_VAL(package[5], 6);
-  data->digital[11] = EXTRACT_GPIO_VAL(package[5], 7);
-
-  data->digital[12] = EXTRACT_GPIO_VAL(package[7], 4);
-  data->digital[13] = EXTRACT_GPIO_VAL(package[7], 5);
-  data->digital[14] = EXTRACT_GPIO_VAL(package[7], 6);
-  data->digital[15] = EXTRACT_GPIO_VAL(package[7], 7);
-
-  data->digital[16] = EXTRACT_GPIO_VAL(package[8], 0);
-  data->digital[17] = EXTRACT_GPIO_VAL(package[8], 1);
-  data->digital[18] = EXTRACT_GPIO_VAL(package[8], 2);
-  data->digital[19] = EXTRACT_GPIO_VAL(package[8], 3);
-  data->digital[20] = EXTRACT_GPIO_VAL(package[8], 4);
-  data->digital[21] = EXTRACT_GPIO_VAL(package[8], 5);
-  data->digital[22] = EXTRACT_GPIO_VAL(package[8], 6);
-  data->digital[23] = EXTRACT_GPIO_VAL(package[8], 7);
+  uint32_t ch = 0;
+  uint32_t pos = 0;
+
+  //Convert analog values incl. four digital channels
+  for(uint32_t i = 0; i < REMOTEIO_ANALOG_CHANNELS; i++) {
+    data->analog[i] = package[pos] | ((package[pos+1] & 0x0F) << 8);
+    pos++;
+    for(uint32_t bit = 4; bit < 8; bit++) {
+      data->digital[ch++] = EXTRACT_GPIO_VAL(package[pos], bit);
+    }
+    pos++;
+  }
+
+  //Convert remaining digital channels
+  for(uint32_t i = 0; i < JOY_FRAME_DIGITAL_BYTES; i++) {
+    for(uint32_t bit = 0; bit < 8 && ch < REMOTEIO_DIGITAL_CHANNELS; bit++) {
+      data->digital[ch++] = EXTRACT_GPIO_VAL(package[pos], bit);
+    }
+    pos++;
+  }
+
+  //Edges (not used in this direction)
+  pos += JOY_FRAME_EDGE_BYTES;
+
+  //Interest mask
+  interest = 0;
+  for(uint32_t i = 0; i < JOY_FRAME_INTEREST_BYTES; i++) {
+    interest |= (uint64_t)package[pos++] << (8*i);
+  }
+}
+
+
+/*******************************************************************************
+ * Packs the status of the firmware update (status, session, next expected
+ * block, CRC of the installed image) into a frame for the joystick-unit. Also
+ * sent without a running update, if the joystick-unit sends update frames
+ * (check of the restart after an update).
+ *
+ * @param pPackage The package which will be filled (uint8_t x[JOY_FRAME_LENGTH])
+ * @return nothing
+ *******************************************************************************/
+static inline void joystickunit_packUpdate(uint8_t* package) {
+  uint32_t nextBlock = firmwareUpdate_getNextBlock();
+  uint32_t installedCrc = firmwareUpdate_getInstalledCrc();
+
+  for(uint32_t i = 0; i < JOY_FRAME_LENGTH - 1; i++) {
+    package[i] = 0;
+  }
+  package[0] = firmwareUpdate_getStatus();
+  package[1] = firmwareUpdate_getSession();
+  package[2] = (nextBlock >> 0) & 0xFF;
+  package[3] = (nextBlock >> 8) & 0xFF;
+  package[UPDATE_POS_DATA + 0] = (installedCrc >> 0) & 0xFF;
+  package[UPDATE_POS_DATA + 1] = (installedCrc >> 8) & 0xFF;
+  package[UPDATE_POS_DATA + 2] = (installedCrc >> 16) & 0xFF;
+  package[UPDATE_POS_DATA + 3] = (installedCrc >> 24) & 0xFF;
+  package[UPDATE_POS_MARKER] = UPDATE_MARKER;
+
+  package[JOY_FRAME_LENGTH - 1] = joystickunit_calcCRC(CRC_UPDATE_START, package, JOY_FRAME_LENGTH - 1);
+}
+
+
+/*******************************************************************************
+ * Handles a frame of a firmware update received from the joystick-unit. Frames
+ * of another session are ignored (except the start of a new one).
+ *
+ * @param pPackage The package received from the joystick-unit (uint8_t x[JOY_FRAME_LENGTH])
+ * @return nothing
+ *******************************************************************************/
+static inline void joystickunit_handleUpdate(uint8_t* package) {
+  uint8_t* data = &package[UPDATE_POS_DATA];
+  uint32_t value = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+
+  if(package[0] == UPDATE_CMD_BEGIN) {
+    firmwareUpdate_begin(package[1], value);
+    return;
+  }
+
+  if(package[1] != firmwareUpdate_getSession()) {
+    return;
+  }
+
+  switch(package[0]) {
+    case UPDATE_CMD_DATA:
+      firmwareUpdate_write(package[2] | (package[3] << 8), data);
+      break;
+    case UPDATE_CMD_END:
+      firmwareUpdate_finish(value);
+      break;
+    case UPDATE_CMD_REBOOT:
+      if(firmwareUpdate_getStatus() == FWUPDATE_DONE) {
+        system_debugMessage(DEBUG_PREFIX "Reset to install update");
+        system_reset();
+      }
+      break;
+    case UPDATE_CMD_STATUS:
+    default:
+      break;
+  }
 }
 
 
 /*******************************************************************************
  * Calculates the checksum from a given uint8_t-array 'pData' with length 'len'.
  *
+ * @param start Start value (CRC_START_VALUE or CRC_UPDATE_START)
  * @param pData A pointer to the data.
  * @param pPackage The size of the data-array
  * @return The CRC-Checksum
  *******************************************************************************/
-uint8_t joystickunit_calcCRC(uint8_t* data, uint32_t len) {
-  uint8_t crc = CRC_START_VALUE;
+uint8_t joystickunit_calcCRC(uint8_t start, uint8_t* data, uint32_t len) {
+  uint8_t crc = start;
 
   while (len--) {
     crc = crc8_table[crc ^ *data++];
@@ -291,12 +594,13 @@ uint8_t joystickunit_calcCRC(uint8_t* data, uint32_t len) {
  * Checks if the checksum of a package is correct. The checksum must be the
  * last byte of the package.
  *
+ * @param start Start value (CRC_START_VALUE or CRC_UPDATE_START)
  * @param pData A pointer to the data.
  * @param pPackage The size of the data-array.
  * @return true if checksum was correct.
  *******************************************************************************/
-static inline bool joystickunit_checkCRC(uint8_t* data, uint32_t len) {
-  uint8_t calculatedCRC = joystickunit_calcCRC(data, len);
+static inline bool joystickunit_checkCRC(uint8_t start, uint8_t* data, uint32_t len) {
+  uint8_t calculatedCRC = joystickunit_calcCRC(start, data, len);
 
   if(calculatedCRC == data[len]) {
     return true;
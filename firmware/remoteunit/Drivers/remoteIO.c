@@ -18,6 +18,54 @@
 #define ENABLE_EXTERNAL_GPIOS
 #define DEBUG_PREFIX      "RemoteIO - "
 #define ADC_SAMPLE_TIME   ADC_SAMPLETIME_56CYCLES
+#define ADC_MAX_CLOCK     36000000  //Hz, max. ADC clock (VDDA > 2.4V)
+#define ADC_SCAN_RATE     8000    //Hz, scans of all analog channels (TIM5)
+#define ADC_BUFFER_SCANS  32      //Scans in circular DMA buffer (4ms)
+#define ADC_BUFFER_LEN    (ADC_BUFFER_SCANS * REMOTEIO_ANALOG_CHANNELS)
+#define ADC_HIGHRES_SHIFT (REMOTEIO_ANALOG_HIGHRES_BITS - 12)
+#define OUTPUT_REFRESH_MS 100     //Period of forced rewrite of unchanged outputs
+#define PASSTHROUGH_IRQ_PRIO 1    //Same as the DAC burst (SPI5), must not nest
+
+#define INTEREST_ANALOG   (REMOTEIO_INTEREST_ANALOG(REMOTEIO_ANALOG_CHANNELS) - 1)
+#define INTEREST_EXTERNAL (REMOTEIO_INTEREST_DIGITAL(11) | REMOTEIO_INTEREST_DIGITAL(12) | \
+                           REMOTEIO_INTEREST_DIGITAL(13) | REMOTEIO_INTEREST_DIGITAL(14) | \
+                           REMOTEIO_INTEREST_DIGITAL(15) | REMOTEIO_INTEREST_DIGITAL(16) | \
+                           REMOTEIO_INTEREST_DIGITAL(17) | REMOTEIO_INTEREST_DIGITAL(23))
+
+//Ports of the internal GPIOs (index into the port tables)
+#define PORT_INDEX(port)  (((port) == GPIOA) ? 0 : ((port) == GPIOB) ? 1 : \
+                           ((port) == GPIOC) ? 2 : 3)
+#define NUM_PORTS         4
+
+
+/* Macros --------------------------------------------------------------------*/
+//Internal GPIOs: X(arg, channel, input, output)
+#define INTERNAL_GPIOS_COMMON(X, arg) \
+  X(arg,  0, DI1,  DO1 ) X(arg,  1, DI2,  DO2 ) X(arg,  2, DI3,  DO3 ) \
+  X(arg,  3, DI4,  DO4 ) X(arg,  4, DI5,  DO5 ) X(arg,  5, DI6,  DO6 ) \
+  X(arg,  6, DI7,  DO7 ) X(arg,  7, DI8,  DO8 ) X(arg,  8, DI9,  DO9 ) \
+  X(arg,  9, DI10, DO10) X(arg, 10, DI11, DO11) X(arg, 18, DI19, DO19) \
+  X(arg, 19, DI20, DO20) X(arg, 20, DI21, DO21) X(arg, 21, DI22, DO22)
+
+#ifndef USE_DEBUG_UART
+#define INTERNAL_GPIOS(X, arg) INTERNAL_GPIOS_COMMON(X, arg) X(arg, 22, DI23, DO23)
+#else
+#define INTERNAL_GPIOS(X, arg) INTERNAL_GPIOS_COMMON(X, arg)
+#endif
+
+//Pin masks of a port, evaluated at compile time
+#define INPUT_PIN(port, ch, in, out)  | (((in##_Port) == (port)) ? (in##_Pin) : 0)
+#define OUTPUT_PIN(port, ch, in, out) | (((out##_Port) == (port)) ? (out##_Pin) : 0)
+#define INPUT_MASK(port)              (0 INTERNAL_GPIOS(INPUT_PIN, port))
+#define OUTPUT_MASK(port)             (0 INTERNAL_GPIOS(OUTPUT_PIN, port))
+
+//Gathers an input from the sampled IDRs / scatters an output into the BSRR-masks
+#define GATHER_INPUT(idr, ch, in, out) \
+  states->digital[ch] = ((idr)[PORT_INDEX(in##_Port)] & (in##_Pin)) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+#define GATHER_EDGE(edges, ch, in, out) \
+  if((edges)[PORT_INDEX(in##_Port)] & (in##_Pin)) states->digitalEdges |= REMOTEIO_EDGE(ch);
+#define SCATTER_OUTPUT(set, ch, in, out) \
+  if(states->digital[ch] == GPIO_PIN_SET) (set)[PORT_INDEX(out##_Port)] |= (out##_Pin);
 
 
 /* Prototypes ----------------------------------------------------------------*/
@@ -25,8 +73,7 @@ static inline void remoteIO_initGPIOs(void);
 static inline void remoteIO_initADC(void);
 static inline void remoteIO_getGPIOs(RemoteIO_States_t* states);
 static inline void remoteIO_getExternalGPIOs(RemoteIO_States_t* states);
-static inline void remoteIO_startADC(RemoteIO_States_t* states);
-static inline void remoteIO_waitForADCs(void);
+static inline void remoteIO_getADCs(RemoteIO_States_t* states);
 static inline void remoteIO_setGPIOs(RemoteIO_States_t* states);
 static inline void remoteIO_setExternalGPIOs(RemoteIO_States_t* states);
 static inline void remoteIO_setDACs(RemoteIO_States_t* states);
@@ -35,27 +82,53 @@ static inline void remoteIO_setDACs(RemoteIO_States_t* states);
 /* Variables -----------------------------------------------------------------*/
 ADC_HandleTypeDef hadc1;
 DMA_HandleTypeDef hdma2_0;
-static uint32_t adcConvFinishedFlag = 0;
+TIM_HandleTypeDef htim5;
+static uint16_t adcBuffer[ADC_BUFFER_LEN];
+static uint32_t adcReadScan = 0;
+static uint32_t lastRefresh = 0;
+static volatile bool analogPassthrough = false;
+static bool externalReady = false;      //GPIO-expander initialized
+static uint8_t lastExternal = 0;        //Last read of the GPIO-expander
+static uint32_t lastIdr[NUM_PORTS];     //Last sample of the internal GPIOs
+static volatile uint32_t idrEdges[NUM_PORTS];   //Latched edges of the internal GPIOs
+
+static GPIO_TypeDef* const ports[NUM_PORTS] = {GPIOA, GPIOB, GPIOC, GPIOH};
+static const uint32_t inputMasks[NUM_PORTS] = {
+    INPUT_MASK(GPIOA), INPUT_MASK(GPIOB), INPUT_MASK(GPIOC), INPUT_MASK(GPIOH)};
+static const uint32_t outputMasks[NUM_PORTS] = {
+    OUTPUT_MASK(GPIOA), OUTPUT_MASK(GPIOB), OUTPUT_MASK(GPIOC), OUTPUT_MASK(GPIOH)};
 
 
 /* Code ----------------------------------------------------------------------*/
 
 /*******************************************************************************
- * Initializes all peripherals needed by the I/Os.
+ * Initializes the peripherals needed by the passthrough right after reset.
  *  - GPIOs
- *  - GPIO-Expander
  *  - ADCs
  *  - DACs
+ * The GPIO-expander is initialized later by remoteIO_initExternal(), as its
+ * configuration blocks on I2C. Until then the external GPIOs are skipped.
  *
  * @return nothing
  *******************************************************************************/
 void remoteIO_init( void ) {
   remoteIO_initGPIOs();
   remoteIO_initADC();
+  dac_init();
+}
+
+
+/*******************************************************************************
+ * Initializes the GPIO-expander (external GPIOs).
+ *
+ * @return nothing
+ *******************************************************************************/
+void remoteIO_initExternal( void ) {
 #ifdef ENABLE_EXTERNAL_GPIOS
   ioExpander_init();
+  lastExternal = ioExpander_getInputs();
+  externalReady = true;
 #endif
-  dac_init();
 }
 
 
@@ -138,16 +211,19 @@ static inline void remoteIO_initGPIOs( void ) {
 
 
 /*******************************************************************************
- * Initializes the needed ADCs
+ * Initializes the needed ADCs. The ADC scans all channels continuously,
+ * triggered by TIM5, and the DMA writes the results to a circular buffer.
  *
  * @return nothing
  *******************************************************************************/
 static inline void remoteIO_initADC(void) {
   ADC_ChannelConfTypeDef sConfig = {0};
   GPIO_InitTypeDef gpioInitStruct = {0};
+  TIM_OC_InitTypeDef sConfigOC = {0};
 
   //Enable peripherals
   __HAL_RCC_ADC1_CLK_ENABLE();
+  __HAL_RCC_TIM5_CLK_ENABLE();
   __DMA2_CLK_ENABLE();
 
   //Init GPIOs for ADC
@@ -163,20 +239,26 @@ static inline void remoteIO_initADC(void) {
 
   //Init ADC
   hadc1.Instance = ADC1;
-  hadc1.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV2;
+  if(HAL_RCC_GetPCLK2Freq() / 2 <= ADC_MAX_CLOCK) {
+    hadc1.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV2;
+  } else if(HAL_RCC_GetPCLK2Freq() / 4 <= ADC_MAX_CLOCK) {
+    hadc1.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV4;
+  } else {
+    hadc1.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV8;
+  }
   hadc1.Init.Resolution = ADC_RESOLUTION_12B;
   hadc1.Init.ScanConvMode = ENABLE;
   hadc1.Init.ContinuousConvMode = DISABLE;
   hadc1.Init.DiscontinuousConvMode = DISABLE;
-  hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_NONE;
-  hadc1.Init.ExternalTrigConv = ADC_SOFTWARE_START;
+  hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+  hadc1.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T5_CC1;
   hadc1.Init.DataAlign = ADC_DATAALIGN_RIGHT;
-  hadc1.Init.NbrOfConversion = 4;
+  hadc1.Init.NbrOfConversion = REMOTEIO_ANALOG_CHANNELS;
   hadc1.Init.DMAContinuousRequests = ENABLE;
   hadc1.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
   if (HAL_ADC_Init(&hadc1) != HAL_OK) {
     system_debugMessage(DEBUG_PREFIX "Cannot init ADC");
-    NVIC_SystemReset();
+    system_reset();
   }
 
   //Configure sequencer
@@ -185,7 +267,7 @@ static inline void remoteIO_initADC(void) {
   sConfig.SamplingTime = ADC_SAMPLE_TIME;
   if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK) {
     system_debugMessage(DEBUG_PREFIX "Sequencer config error (1)");
-    NVIC_SystemReset();
+    system_reset();
   }
 
   sConfig.Channel = AI2_Channel;
@@ -193,7 +275,7 @@ static inline void remoteIO_initADC(void) {
   sConfig.SamplingTime = ADC_SAMPLE_TIME;
   if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK) {
     system_debugMessage(DEBUG_PREFIX "Sequencer config error (2)");
-    NVIC_SystemReset();
+    system_reset();
   }
 
   sConfig.Channel = AI3_Channel;
@@ -201,7 +283,7 @@ static inline void remoteIO_initADC(void) {
   sConfig.SamplingTime = ADC_SAMPLE_TIME;
   if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK) {
     system_debugMessage(DEBUG_PREFIX "Sequencer config error (3)");
-    NVIC_SystemReset();
+    system_reset();
   }
 
   sConfig.Channel = AI4_Channel;
@@ -209,7 +291,7 @@ static inline void remoteIO_initADC(void) {
   sConfig.SamplingTime = ADC_SAMPLE_TIME;
   if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK) {
     system_debugMessage(DEBUG_PREFIX "Sequencer config error (4)");
-    NVIC_SystemReset();
+    system_reset();
   }
 
   //Configure DMA
@@ -218,92 +300,213 @@ static inline void remoteIO_initADC(void) {
   hdma2_0.Init.Direction = DMA_PERIPH_TO_MEMORY;
   hdma2_0.Init.PeriphInc = DMA_PINC_DISABLE;
   hdma2_0.Init.MemInc = DMA_MINC_ENABLE;
-  hdma2_0.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
-  hdma2_0.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
-  hdma2_0.Init.Mode = DMA_NORMAL;
+  hdma2_0.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+  hdma2_0.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+  hdma2_0.Init.Mode = DMA_CIRCULAR;
   hdma2_0.Init.Priority = DMA_PRIORITY_HIGH;
   hdma2_0.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
   if (HAL_DMA_Init(&hdma2_0) != HAL_OK) {
     system_debugMessage(DEBUG_PREFIX "Cannot init DMA");
-    NVIC_SystemReset();
+    system_reset();
   }
 
   __HAL_LINKDMA(&hadc1, DMA_Handle, hdma2_0);
-  NVIC_SetPriority(DMA2_Stream0_IRQn, 1);
-  NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+
+  //Configure trigger timer (1 MHz, compare event once per scan)
+  htim5.Instance = TIM5;
+  htim5.Init.Prescaler = (system_getTimerClock(TIM5) / 1000000) - 1;
+  htim5.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim5.Init.Period = (1000000 / ADC_SCAN_RATE) - 1;
+  htim5.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim5.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if (HAL_TIM_PWM_Init(&htim5) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot init ADC timer");
+    system_reset();
+  }
+
+  sConfigOC.OCMode = TIM_OCMODE_PWM1;
+  sConfigOC.Pulse = (1000000 / ADC_SCAN_RATE) / 2;
+  sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+  sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+  if (HAL_TIM_PWM_ConfigChannel(&htim5, &sConfigOC, TIM_CHANNEL_1) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot config ADC timer");
+    system_reset();
+  }
+
+  //Start acquisition (the DMA interrupts are not needed, the buffer is polled)
+  if (HAL_ADC_Start_DMA(&hadc1, (uint32_t*)adcBuffer, ADC_BUFFER_LEN) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot start ADC");
+    system_reset();
+  }
+  __HAL_DMA_DISABLE_IT(&hdma2_0, DMA_IT_TC | DMA_IT_HT);
+
+  if (HAL_TIM_PWM_Start(&htim5, TIM_CHANNEL_1) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot start ADC timer");
+    system_reset();
+  }
+
+  //Update event of the trigger timer latches the edges of the internal GPIOs
+  //and drives the analog passthrough (see remoteIO_setAnalogPassthrough())
+  for(uint32_t i = 0; i < NUM_PORTS; i++) {
+    lastIdr[i] = ports[i]->IDR;
+  }
+  __HAL_TIM_CLEAR_FLAG(&htim5, TIM_FLAG_UPDATE);
+  __HAL_TIM_ENABLE_IT(&htim5, TIM_IT_UPDATE);
+  NVIC_SetPriority(TIM5_IRQn, PASSTHROUGH_IRQ_PRIO);
+  NVIC_EnableIRQ(TIM5_IRQn);
 }
 
 
 /*******************************************************************************
- * Reads all inputs and stores it the states struct
+ * Reads the inputs and stores it the states struct. The ADCs and the external
+ * GPIOs are skipped if none of their channels is of interest (or the
+ * GPIO-expander is not initialized yet), these channels keep their old value.
+ * Digital channels with an edge since the last read are added to digitalEdges
+ * (cleared by the consumer), so short pulses between two reads are not lost.
+ * The analog values are the average of all scans since the last read (the ADC
+ * runs continuously, so there is no waiting).
  *
  * @param states The input-state-struct to write data to
+ * @param interest The inputs which are needed (REMOTEIO_INTEREST_x)
  * @return nothing
  *******************************************************************************/
-void remoteIO_getStates(RemoteIO_States_t* states) {
-  remoteIO_startADC(states);
+void remoteIO_getStates(RemoteIO_States_t* states, uint64_t interest) {
   remoteIO_getGPIOs(states);
 #ifdef ENABLE_EXTERNAL_GPIOS
-  remoteIO_getExternalGPIOs(states);
+  if(externalReady && (interest & INTEREST_EXTERNAL)) {
+    remoteIO_getExternalGPIOs(states);
+  }
 #endif
-  remoteIO_waitForADCs();
+  if(interest & INTEREST_ANALOG) {
+    remoteIO_getADCs(states);
+  }
 }
 
 
 /*******************************************************************************
- * Writes to the outputs, according to the states-struct.
+ * Writes to the outputs, according to the states-struct. The GPIO-expander and
+ * the DACs are only written if their values changed, all outputs are
+ * rewritten every OUTPUT_REFRESH_MS.
  *
  * @param states The data which should be written to the outputs
  * @return nothing
  *******************************************************************************/
 void remoteIO_setStates(RemoteIO_States_t* states) {
+  if(HAL_GetTick() - lastRefresh >= OUTPUT_REFRESH_MS) {
+    lastRefresh = HAL_GetTick();
+#ifdef ENABLE_EXTERNAL_GPIOS
+    ioExpander_refresh();
+#endif
+    dac_refresh();
+  }
+
   remoteIO_setGPIOs(states);
 #ifdef ENABLE_EXTERNAL_GPIOS
-  remoteIO_setExternalGPIOs(states);
+  if(externalReady) {
+    remoteIO_setExternalGPIOs(states);
+  }
+#endif
+  if(!analogPassthrough) {
+    remoteIO_setDACs(states);
+  }
+}
+
+
+/*******************************************************************************
+ * Enables or disables the analog passthrough. If enabled, the DACs are written
+ * with the latest ADC scan from the interrupt of the trigger timer, half a scan
+ * period after the conversion was started. The passthrough runs at the scan
+ * rate with a fixed latency and does not depend on the main loop,
+ * remoteIO_setStates() does not write the DACs meanwhile.
+ * Must not be called from an interrupt.
+ *
+ * @param enable true to pass the analog inputs through to the DACs
+ * @return nothing
+ *******************************************************************************/
+void remoteIO_setAnalogPassthrough(bool enable) {
+  if(enable == analogPassthrough) {
+    return;
+  }
+
+  //The interrupt has a higher priority, no DAC write of it after this point
+  analogPassthrough = enable;
+  if(!enable) {
+    dac_refresh();
+  }
+}
+
+
+/*******************************************************************************
+ * Returns the number of bus transactions (I2C writes and DAC words), which were
+ * skipped because the outputs did not change.
+ *
+ * @return saved bus transactions
+ *******************************************************************************/
+uint32_t remoteIO_getSavedTransactions(void) {
+#ifdef ENABLE_EXTERNAL_GPIOS
+  return ioExpander_getSkippedWrites() + dac_getSkippedWrites();
+#else
+  return dac_getSkippedWrites();
 #endif
-  remoteIO_setDACs(states);
 }
 
 
 /*******************************************************************************
- * Reads in the GPIOs and stores there values to the state-struct
+ * Reads in the GPIOs and stores there values to the state-struct. Each port is
+ * sampled with a single read of its IDR, so all channels are sampled at once.
+ * The edges between two reads are latched at the scan rate by TIM5_IRQHandler().
  *
  * @param states The state struct
  * @return nothing
  *******************************************************************************/
 static inline void remoteIO_getGPIOs(RemoteIO_States_t* states) {
-  states->digital[ 0] = HAL_GPIO_ReadPin( DI1_Port,  DI1_Pin );
-  states->digital[ 1] = HAL_GPIO_ReadPin( DI2_Port,  DI2_Pin );
-  states->digital[ 2] = HAL_GPIO_ReadPin( DI3_Port,  DI3_Pin );
-  states->digital[ 3] = HAL_GPIO_ReadPin( DI4_Port,  DI4_Pin );
-  states->digital[ 4] = HAL_GPIO_ReadPin( DI5_Port,  DI5_Pin );
-  states->digital[ 5] = HAL_GPIO_ReadPin( DI6_Port,  DI6_Pin );
-  states->digital[ 6] = HAL_GPIO_ReadPin( DI7_Port,  DI7_Pin );
-  states->digital[ 7] = HAL_GPIO_ReadPin( DI8_Port,  DI8_Pin );
-  states->digital[ 8] = HAL_GPIO_ReadPin( DI9_Port,  DI9_Pin );
-  states->digital[ 9] = HAL_GPIO_ReadPin( DI10_Port, DI10_Pin);
-  states->digital[10] = HAL_GPIO_ReadPin( DI11_Port, DI11_Pin);
-  states->digital[18] = HAL_GPIO_ReadPin( DI19_Port, DI19_Pin);
-  states->digital[19] = HAL_GPIO_ReadPin( DI20_Port, DI20_Pin);
-  states->digital[20] = HAL_GPIO_ReadPin( DI21_Port, DI21_Pin);
-  states->digital[21] = HAL_GPIO_ReadPin( DI22_Port, DI22_Pin);
+  uint32_t idr[NUM_PORTS] = {0};
+  uint32_t edges[NUM_PORTS] = {0};
+  uint32_t primask;
+
+  //Sample ports and collect the edges latched by the timer interrupt
+  primask = __get_PRIMASK();
+  __disable_irq();
+  for(uint32_t i = 0; i < NUM_PORTS; i++) {
+    if(inputMasks[i] != 0) {
+      idr[i] = ports[i]->IDR;
+      edges[i] = idrEdges[i] | ((idr[i] ^ lastIdr[i]) & inputMasks[i]);
+      idrEdges[i] = 0;
+      lastIdr[i] = idr[i];
+    }
+  }
+  __set_PRIMASK(primask);
 
-#ifndef USE_DEBUG_UART
-  states->digital[22] = HAL_GPIO_ReadPin( DI23_Port, DI23_Pin);
-#else
+  INTERNAL_GPIOS(GATHER_INPUT, idr)
+  INTERNAL_GPIOS(GATHER_EDGE, edges)
+
+#ifdef USE_DEBUG_UART
   states->digital[22] = GPIO_PIN_SET;
 #endif
 }
 
 
 /*******************************************************************************
- * Reads in the external GPIOs and stores there values to the state-struct
+ * Reads in the external GPIOs and stores there values to the state-struct. The
+ * interrupt output of the GPIO-expander is not connected, so only edges
+ * between two reads of the expander are detected.
  *
  * @param states The state struct
  * @return nothing
  *******************************************************************************/
 static inline void remoteIO_getExternalGPIOs(RemoteIO_States_t* states) {
   uint8_t data = ioExpander_getInputs();
+  uint8_t changed = data ^ lastExternal;
+
+  lastExternal = data;
+  states->digitalEdges |= (changed & DI12_Pin) ? REMOTEIO_EDGE(11) : 0;
+  states->digitalEdges |= (changed & DI13_Pin) ? REMOTEIO_EDGE(12) : 0;
+  states->digitalEdges |= (changed & DI14_Pin) ? REMOTEIO_EDGE(13) : 0;
+  states->digitalEdges |= (changed & DI15_Pin) ? REMOTEIO_EDGE(14) : 0;
+  states->digitalEdges |= (changed & DI16_Pin) ? REMOTEIO_EDGE(15) : 0;
+  states->digitalEdges |= (changed & DI17_Pin) ? REMOTEIO_EDGE(16) : 0;
+  states->digitalEdges |= (changed & DI18_Pin) ? REMOTEIO_EDGE(17) : 0;
+  states->digitalEdges |= (changed & DI24_Pin) ? REMOTEIO_EDGE(23) : 0;
 
   states->digital[11] = (data & DI12_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
   states->digital[12] = (data & DI13_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
@@ -317,78 +520,58 @@ static inline void remoteIO_getExternalGPIOs(RemoteIO_States_t* states) {
 
 
 /*******************************************************************************
- * Starts an ADC converstion with the state struct as destination.
+ * Averages the scans, which were completed since the last call, and stores the
+ * result to the state struct (12 bit and REMOTEIO_ANALOG_HIGHRES_BITS). If no
+ * new scan is available, the old values are kept.
  *
  * @param states The state struct
  * @return nothing
  *******************************************************************************/
-static inline void remoteIO_startADC(RemoteIO_States_t* states) {
-  HAL_ADC_Start_DMA(&hadc1, states->analog, 4);
-}
-
-
-/*******************************************************************************
- * DMA callback of ADC
- *
- * @return nothing
- *******************************************************************************/
-void DMA2_Stream0_IRQHandler(DMA_HandleTypeDef* hdma) {
-  uint32_t* isrRegister  = ((uint32_t*)DMA2_BASE) + 0;
-  uint32_t* ifcrRegister = ((uint32_t*)DMA2_BASE) + 2;
-
-  if((*isrRegister & DMA_FLAG_HTIF0_4) != RESET) {
-    *ifcrRegister = DMA_FLAG_HTIF0_4;
+static inline void remoteIO_getADCs(RemoteIO_States_t* states) {
+  uint32_t sum[REMOTEIO_ANALOG_CHANNELS] = {0};
+  uint32_t writeScan, numScans;
+  uint16_t* scan;
+
+  //Only complete scans (the DMA counts down the remaining transfers)
+  writeScan = (ADC_BUFFER_LEN - __HAL_DMA_GET_COUNTER(&hdma2_0)) / REMOTEIO_ANALOG_CHANNELS;
+  numScans = (writeScan + ADC_BUFFER_SCANS - adcReadScan) % ADC_BUFFER_SCANS;
+  if(numScans == 0) {
+    return;
   }
 
-  if((*isrRegister & DMA_FLAG_TCIF0_4) != RESET) {
-    *ifcrRegister = DMA_FLAG_TCIF0_4;
-    adcConvFinishedFlag = 1;
-    HAL_ADC_Stop_DMA(&hadc1);
+  for(uint32_t i = 0; i < numScans; i++) {
+    scan = &adcBuffer[((adcReadScan + i) % ADC_BUFFER_SCANS) * REMOTEIO_ANALOG_CHANNELS];
+    for(uint32_t ch = 0; ch < REMOTEIO_ANALOG_CHANNELS; ch++) {
+      sum[ch] += scan[ch];
+    }
   }
-}
-
+  adcReadScan = writeScan;
 
-/*******************************************************************************
- * Blocking wait for ADCs to finish conversion.
- *
- * @return nothing
- *******************************************************************************/
-static inline void remoteIO_waitForADCs( void ) {
-  while(adcConvFinishedFlag == 0);
-
-  //Reset flag
-  adcConvFinishedFlag = 0;
+  for(uint32_t ch = 0; ch < REMOTEIO_ANALOG_CHANNELS; ch++) {
+    states->analog[ch] = (sum[ch] + numScans / 2) / numScans;
+    states->analogHighRes[ch] = ((sum[ch] << ADC_HIGHRES_SHIFT) + numScans / 2) / numScans;
+  }
 }
 
 
 /*******************************************************************************
- * Sets all GPIOs according to theire states in the state-vector.
+ * Sets all GPIOs according to theire states in the state-vector. Each port is
+ * written with a single write to its BSRR, so all channels change at once.
  *
  * @param states The state struct
  * @return nothing
  *******************************************************************************/
 static inline void remoteIO_setGPIOs(RemoteIO_States_t* states) {
-  HAL_GPIO_WritePin( DO1_Port,  DO1_Pin,  states->digital[ 0] );
-  HAL_GPIO_WritePin( DO2_Port,  DO2_Pin,  states->digital[ 1] );
-  HAL_GPIO_WritePin( DO3_Port,  DO3_Pin,  states->digital[ 2] );
-  HAL_GPIO_WritePin( DO4_Port,  DO4_Pin,  states->digital[ 3] );
-  HAL_GPIO_WritePin( DO5_Port,  DO5_Pin,  states->digital[ 4] );
-  HAL_GPIO_WritePin( DO6_Port,  DO6_Pin,  states->digital[ 5] );
-  HAL_GPIO_WritePin( DO7_Port,  DO7_Pin,  states->digital[ 6] );
-  HAL_GPIO_WritePin( DO8_Port,  DO8_Pin,  states->digital[ 7] );
-  HAL_GPIO_WritePin( DO9_Port,  DO9_Pin,  states->digital[ 8] );
-  HAL_GPIO_WritePin( DO10_Port, DO10_Pin, states->digital[ 9] );
-  HAL_GPIO_WritePin( DO11_Port, DO11_Pin, states->digital[10] );
-  HAL_GPIO_WritePin( DO19_Port, DO19_Pin, states->digital[18] );
-  HAL_GPIO_WritePin( DO20_Port, DO20_Pin, states->digital[19] );
-  HAL_GPIO_WritePin( DO21_Port, DO21_Pin, states->digital[20] );
-  HAL_GPIO_WritePin( DO22_Port, DO22_Pin, states->digital[21] );
+  uint32_t set[NUM_PORTS] = {0};
 
-#ifndef USE_DEBUG_UART
-  HAL_GPIO_WritePin(DO23_Port, DO23_Pin, states->digital[22]);
-#else
-  HAL_GPIO_WritePin(DO23_Port, DO23_Pin, GPIO_PIN_SET);
-#endif
+  INTERNAL_GPIOS(SCATTER_OUTPUT, set)
+
+  //Set and reset pins of a port with one write
+  for(uint32_t i = 0; i < NUM_PORTS; i++) {
+    if(outputMasks[i] != 0) {
+      ports[i]->BSRR = set[i] | ((outputMasks[i] & ~set[i]) << 16);
+    }
+  }
 }
 
 
@@ -423,3 +606,35 @@ static inline void remoteIO_setExternalGPIOs(RemoteIO_States_t* states) {
 static inline void remoteIO_setDACs(RemoteIO_States_t* states) {
   dac_setAllChannels(states->analog[2], states->analog[3], states->analog[0], states->analog[1]);
 }
+
+
+/*******************************************************************************
+ * Timer interrupt (update event, once per scan): Latches the edges of the
+ * internal GPIOs and, if the analog passthrough is enabled, passes the latest
+ * complete ADC scan through to the DACs. The scan was started half a scan
+ * period before and is finished, the DAC burst continues in the SPI interrupt.
+ *
+ * @return nothing
+ *******************************************************************************/
+void TIM5_IRQHandler(void) {
+  uint32_t writeScan, idr;
+  uint16_t* scan;
+
+  if(__HAL_TIM_GET_FLAG(&htim5, TIM_FLAG_UPDATE) != RESET) {
+    __HAL_TIM_CLEAR_FLAG(&htim5, TIM_FLAG_UPDATE);
+
+    for(uint32_t i = 0; i < NUM_PORTS; i++) {
+      idr = ports[i]->IDR;
+      idrEdges[i] |= (idr ^ lastIdr[i]) & inputMasks[i];
+      lastIdr[i] = idr;
+    }
+
+    if(analogPassthrough) {
+      writeScan = (ADC_BUFFER_LEN - __HAL_DMA_GET_COUNTER(&hdma2_0)) / REMOTEIO_ANALOG_CHANNELS;
+      scan = &adcBuffer[((writeScan + ADC_BUFFER_SCANS - 1) % ADC_BUFFER_SCANS) * REMOTEIO_ANALOG_CHANNELS];
+
+      //Same channel mapping as remoteIO_setDACs()
+      dac_setAllChannels(scan[2], scan[3], scan[0], scan[1]);
+    }
+  }
+}
@@ -0,0 +1,167 @@
+/*******************************************************************************
+* @file         : scheduler.c
+* @project      : 4D-Joystick, Remote-Unit
+* @author       : Fabian Baer
+* @brief        : Cooperative scheduler paced by a hardware timer
+*******************************************************************************/
+
+/* Includes ------------------------------------------------------------------*/
+#include <stm32f4xx_hal.h>
+#include <board.h>
+#include <system.h>
+#include <scheduler.h>
+
+
+/* Defines -------------------------------------------------------------------*/
+#define DEBUG_PREFIX        "Sched - "
+
+
+/* Variables -----------------------------------------------------------------*/
+TIM_HandleTypeDef htim6;
+static volatile uint32_t tick = 0;
+static uint32_t missedTicks = 0;
+static uint32_t idleTime = 0;     //us, sleep time since last call of getLoad
+static uint32_t loadTicks = 0;    //Ticks since last call of getLoad
+
+
+/* Code ----------------------------------------------------------------------*/
+
+/*******************************************************************************
+ * Initializes the timer of the scheduler (TIM6). The execution times are
+ * measured with the cycle counter (enabled by system_init()).
+ *
+ * @return nothing
+ *******************************************************************************/
+void scheduler_init(void) {
+  //Init timer (1 MHz)
+  __HAL_RCC_TIM6_CLK_ENABLE();
+
+  htim6.Instance = TIM6;
+  htim6.Init.Prescaler = (system_getTimerClock(TIM6) / 1000000) - 1;
+  htim6.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim6.Init.Period = SCHEDULER_TICK_US - 1;
+  htim6.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if (HAL_TIM_Base_Init(&htim6) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot init timer");
+    system_reset();
+  }
+
+  NVIC_SetPriority(TIM6_DAC_IRQn, 2);
+  NVIC_EnableIRQ(TIM6_DAC_IRQn);
+}
+
+
+/*******************************************************************************
+ * Runs the jobs according to their period (never returns). The jobs of a tick
+ * are executed in the order of the job table, the CPU sleeps between the ticks
+ * (sleep mode, woken up by the next interrupt).
+ *
+ * @param jobs The job table
+ * @param numJobs Number of jobs in the table
+ * @return nothing
+ *******************************************************************************/
+void scheduler_run(Scheduler_Job_t* jobs, uint32_t numJobs) {
+  uint32_t lastTick, curTick, start;
+  uint32_t cyclesPerUs = SystemCoreClock / 1000000;
+
+  for(uint32_t i = 0; i < numJobs; i++) {
+    jobs[i].nextRun = jobs[i].offset;
+  }
+
+  if (HAL_TIM_Base_Start_IT(&htim6) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot start timer");
+    system_reset();
+  }
+  lastTick = tick;
+
+  while(1) {
+    //Sleep until next tick. Interrupts are masked while checking the tick, so
+    //the tick interrupt cannot get lost between check and WFI (a pending
+    //interrupt wakes up the CPU, even if masked).
+    __disable_irq();
+    if(tick == lastTick) {
+      idleTime += SCHEDULER_TICK_US - __HAL_TIM_GET_COUNTER(&htim6);
+    }
+    while(tick == lastTick) {
+      __WFI();
+      __enable_irq();
+      __disable_irq();
+    }
+    curTick = tick;
+    __enable_irq();
+
+    if(curTick - lastTick > 1) {
+      missedTicks += curTick - lastTick - 1;
+      system_debugMessage(DEBUG_PREFIX "Missed tick");
+    }
+    loadTicks += curTick - lastTick;
+    lastTick = curTick;
+
+    //Execute due jobs
+    for(uint32_t i = 0; i < numJobs; i++) {
+      if((int32_t)(curTick - jobs[i].nextRun) < 0) {
+        continue;
+      }
+
+      start = DWT->CYCCNT;
+      jobs[i].function();
+      jobs[i].execTime = (DWT->CYCCNT - start) / cyclesPerUs;
+
+      if(jobs[i].execTime > jobs[i].maxExecTime) {
+        jobs[i].maxExecTime = jobs[i].execTime;
+      }
+
+      //Execution took longer than period or the job was released too late
+      jobs[i].nextRun += jobs[i].period;
+      if(jobs[i].execTime > jobs[i].period * SCHEDULER_TICK_US ||
+          (int32_t)(curTick - jobs[i].nextRun) >= 0) {
+        jobs[i].overruns++;
+        jobs[i].nextRun = curTick + jobs[i].period;
+        system_debugMessage(DEBUG_PREFIX "Job overrun");
+      }
+    }
+  }
+}
+
+
+/*******************************************************************************
+ * Returns the number of ticks, which were missed because the jobs of a tick
+ * took longer than SCHEDULER_TICK_US.
+ *
+ * @return missed ticks
+ *******************************************************************************/
+uint32_t scheduler_getMissedTicks(void) {
+  return missedTicks;
+}
+
+
+/*******************************************************************************
+ * Returns the CPU load (time not spent sleeping) since the last call.
+ *
+ * @return load in per mille
+ *******************************************************************************/
+uint32_t scheduler_getLoad(void) {
+  uint32_t total = loadTicks * SCHEDULER_TICK_US;
+  uint32_t idle = idleTime;
+
+  loadTicks = 0;
+  idleTime = 0;
+
+  if(total == 0 || idle > total) {
+    return 0;
+  }
+  return 1000 - (uint32_t)(((uint64_t)idle * 1000) / total);
+}
+
+
+/*******************************************************************************
+ * Timer interrupt (scheduler tick)
+ *
+ * @return nothing
+ *******************************************************************************/
+void TIM6_DAC_IRQHandler(void) {
+  if(__HAL_TIM_GET_FLAG(&htim6, TIM_FLAG_UPDATE) != RESET) {
+    __HAL_TIM_CLEAR_FLAG(&htim6, TIM_FLAG_UPDATE);
+    tick++;
+  }
+}
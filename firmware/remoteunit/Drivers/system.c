@@ -6,6 +6,7 @@
 *******************************************************************************/
 
 /* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
 #include "stm32f4xx.h"
 #include "stm32f4xx_hal.h"
 #include "board.h"
@@ -14,7 +15,35 @@
 
 /* Defines -------------------------------------------------------------------*/
 #define DEBUG_PREFIX        "Sys - "
-#define VECT_TAB_OFFSET     0x00
+#define VECT_TAB_OFFSET     0x4000    //Application behind the bootloader (sector 0)
+#define DEBUG_VALUE_BUFFER  64
+#define LOG_BUFFER_SIZE     512       //Bytes, ring buffer of debug-UART
+#define LOG_FLUSH_LOOPS     1000000   //Max. polling loops to flush the log
+
+
+/* Prototypes ----------------------------------------------------------------*/
+#ifdef USE_DEBUG_UART
+static inline uint32_t system_writeLog(uint32_t pos, uint8_t* data, uint32_t size);
+static void system_startLogTransfer(void);
+#endif
+
+//Clock profiles (PLL input is HSI / PLLM = 1 MHz, flash latency for 2.7-3.6V)
+#if SYSTEM_CLOCK_MHZ == 100
+  #define CLOCK_PLLN          400
+  #define CLOCK_PLLP          RCC_PLLP_DIV4
+  #define CLOCK_APB1_DIVIDER  RCC_HCLK_DIV2     //APB1 max. 50 MHz
+  #define CLOCK_FLASH_LATENCY FLASH_LATENCY_3
+#elif SYSTEM_CLOCK_MHZ == 48
+  #define CLOCK_PLLN          192
+  #define CLOCK_PLLP          RCC_PLLP_DIV4
+  #define CLOCK_APB1_DIVIDER  RCC_HCLK_DIV1
+  #define CLOCK_FLASH_LATENCY FLASH_LATENCY_1
+#elif SYSTEM_CLOCK_MHZ == 16
+  #define CLOCK_APB1_DIVIDER  RCC_HCLK_DIV1
+  #define CLOCK_FLASH_LATENCY FLASH_LATENCY_0
+#else
+  #error "Unsupported clock profile (SYSTEM_CLOCK_MHZ)"
+#endif
 
 
 /* Variables -----------------------------------------------------------------*/
@@ -23,23 +52,45 @@ const uint8_t AHBPrescTable[16] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 6, 7, 8,
 const uint8_t APBPrescTable[8]  = {0, 0, 0, 0, 1, 2, 3, 4};
 IWDG_HandleTypeDef hiwdg;
 UART_HandleTypeDef huart1;
+DMA_HandleTypeDef hdma2_7;
+static uint8_t resetCause = 0;
+
+#ifdef USE_DEBUG_UART
+static uint8_t logBuffer[LOG_BUFFER_SIZE];
+static volatile uint32_t logWrite = 0;      //Next byte written by messages
+static volatile uint32_t logRead = 0;       //Next byte transmitted
+static volatile uint32_t logTxLength = 0;   //Bytes of running transfer (0 = idle)
+static volatile uint32_t logDrops = 0;
+static bool logReady = false;               //UART initialized (system_initDebug)
+#endif
 
 
 
 /* Code ----------------------------------------------------------------------*/
 
 /*******************************************************************************
- * Initializes all general system resources:
- *  - clocks
+ * Initializes the general system resources needed right after reset:
+ *  - GPIO clocks
+ *  - cycle counter (execution times and boot timestamps)
  *  - debug LED
- *  - debug UART
  *  - Watchdog
+ * The debug UART is initialized later by system_initDebug(), so the
+ * passthrough is not delayed.
  *
  * @return nothing
  *******************************************************************************/
 void system_init(void) {
   GPIO_InitTypeDef GPIO_InitStruct = {0};
 
+  //Store reset flags (RCC_CSR bits 24-31) for the next reset
+  resetCause = (uint8_t)(RCC->CSR >> 24);
+  __HAL_RCC_CLEAR_RESET_FLAGS();
+
+  //Enable cycle counter
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
   //Enable all GPIO clocks
   __HAL_RCC_GPIOA_CLK_ENABLE();
   __HAL_RCC_GPIOB_CLK_ENABLE();
@@ -54,8 +105,30 @@ void system_init(void) {
   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
   HAL_GPIO_Init(DEBUG_LED_Port, &GPIO_InitStruct);
 
-  //Init UART
+  //Init Watchdog (15ms)
+#ifdef ENABLE_WATCHDOG
+  hiwdg.Instance = IWDG;
+  hiwdg.Init.Prescaler = IWDG_PRESCALER_4;
+  hiwdg.Init.Reload = 120;
+  if (HAL_IWDG_Init(&hiwdg) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot init Watchdog");
+    system_reset();
+  }
+#endif
+}
+
+
+/*******************************************************************************
+ * Initializes the debug UART. Messages written before are kept in the log ring
+ * buffer and transmitted now.
+ *
+ * @return nothing
+ *******************************************************************************/
+void system_initDebug(void) {
 #ifdef USE_DEBUG_UART
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+  uint32_t primask;
+
   __HAL_RCC_USART1_CLK_ENABLE();
 
   GPIO_InitStruct.Pin = DI23_Pin | DO23_Pin;
@@ -75,22 +148,44 @@ void system_init(void) {
   huart1.Init.OverSampling = UART_OVERSAMPLING_16;
   if (HAL_UART_Init(&huart1) != HAL_OK) {
     system_debugMessage(DEBUG_PREFIX "Cannot init UART");
-    NVIC_SystemReset();
+    system_reset();
   }
-#endif
 
-  //Init Watchdog (15ms)
-#ifdef ENABLE_WATCHDOG
-  hiwdg.Instance = IWDG;
-  hiwdg.Init.Prescaler = IWDG_PRESCALER_4;
-  hiwdg.Init.Reload = 120;
-  if (HAL_IWDG_Init(&hiwdg) != HAL_OK) {
-    system_debugMessage(DEBUG_PREFIX "Cannot init Watchdog");
-    NVIC_SystemReset();
+  //Init DMA for UART (USART1_TX: DMA2 Stream7 Channel4)
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  hdma2_7.Instance = DMA2_Stream7;
+  hdma2_7.Init.Channel = DMA_CHANNEL_4;
+  hdma2_7.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  hdma2_7.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma2_7.Init.MemInc = DMA_MINC_ENABLE;
+  hdma2_7.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma2_7.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma2_7.Init.Mode = DMA_NORMAL;
+  hdma2_7.Init.Priority = DMA_PRIORITY_LOW;
+  hdma2_7.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  if (HAL_DMA_Init(&hdma2_7) != HAL_OK) {
+    system_debugMessage(DEBUG_PREFIX "Cannot init UART DMA");
+    system_reset();
   }
+  __HAL_LINKDMA(&huart1, hdmatx, hdma2_7);
+
+  //Lowest priority, logging must not delay the control loop
+  NVIC_SetPriority(DMA2_Stream7_IRQn, 3);
+  NVIC_EnableIRQ(DMA2_Stream7_IRQn);
+  NVIC_SetPriority(USART1_IRQn, 3);
+  NVIC_EnableIRQ(USART1_IRQn);
+
+  //Transmit the messages written during the boot
+  primask = __get_PRIMASK();
+  __disable_irq();
+  logReady = true;
+  system_startLogTransfer();
+  __set_PRIMASK(primask);
 #endif
 }
 
+
 void system_watchdogHandler( void ) {
 #ifdef ENABLE_WATCHDOG
   HAL_IWDG_Refresh(&hiwdg);
@@ -99,7 +194,8 @@ void system_watchdogHandler( void ) {
 
 
 /*******************************************************************************
- * Initializes the system clocks
+ * Initializes the system clocks according to the clock profile
+ * (SYSTEM_CLOCK_MHZ). Only HSI is used, for the faster profiles via the PLL.
  *
  * @return nothing
  *******************************************************************************/
@@ -115,24 +211,83 @@ void system_setupClock(void) {
   RCC_OscInitStruct.HSIState = RCC_HSI_ON;
   RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
   RCC_OscInitStruct.LSIState = RCC_LSI_ON;
+#if SYSTEM_CLOCK_MHZ == 16
   RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
+#else
+  RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
+  RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSI;
+  RCC_OscInitStruct.PLL.PLLM = HSI_VALUE / 1000000;
+  RCC_OscInitStruct.PLL.PLLN = CLOCK_PLLN;
+  RCC_OscInitStruct.PLL.PLLP = CLOCK_PLLP;
+  RCC_OscInitStruct.PLL.PLLQ = 4;
+  RCC_OscInitStruct.PLL.PLLR = 2;
+#endif
   if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK) {
-    NVIC_SystemReset();
+    system_reset();
   }
 
   RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK
       | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+#if SYSTEM_CLOCK_MHZ == 16
   RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
+#else
+  RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+#endif
   RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
-  RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
+  RCC_ClkInitStruct.APB1CLKDivider = CLOCK_APB1_DIVIDER;
   RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
 
-  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0) != HAL_OK) {
-    NVIC_SystemReset();
+  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, CLOCK_FLASH_LATENCY) != HAL_OK) {
+    system_reset();
   }
 }
 
 
+/*******************************************************************************
+ * Returns the clock of a timer. If the APB of the timer is divided, the timer
+ * runs at twice the APB clock.
+ *
+ * @param timer The timer (e.g. TIM6)
+ * @return timer clock in Hz
+ *******************************************************************************/
+uint32_t system_getTimerClock(TIM_TypeDef* timer) {
+  if((uint32_t)timer >= APB2PERIPH_BASE) {
+    if((RCC->CFGR & RCC_CFGR_PPRE2) == (RCC_HCLK_DIV1 << 3)) {
+      return HAL_RCC_GetPCLK2Freq();
+    }
+    return HAL_RCC_GetPCLK2Freq() * 2;
+  }
+
+  if((RCC->CFGR & RCC_CFGR_PPRE1) == RCC_HCLK_DIV1) {
+    return HAL_RCC_GetPCLK1Freq();
+  }
+  return HAL_RCC_GetPCLK1Freq() * 2;
+}
+
+
+/*******************************************************************************
+ * Returns the cause of the last reset.
+ *
+ * @return reset flags (RCC_CSR bits 24-31)
+ *******************************************************************************/
+uint8_t system_getResetCause(void) {
+  return resetCause;
+}
+
+
+/*******************************************************************************
+ * Resets the controller. Pending debug messages are transmitted before.
+ *
+ * @return nothing
+ *******************************************************************************/
+void system_reset(void) {
+#ifdef USE_DEBUG_UART
+  system_flushDebug();
+#endif
+  NVIC_SystemReset();
+}
+
+
 /*******************************************************************************
  * Basic configuration of controller. This function is called before main() is
  * started.
@@ -203,24 +358,190 @@ UART_HandleTypeDef* system_getUartHandle( void ) {
  * Do not use this function directly. Instead use the macro system_debugMessage.
  * Debug-UART can be disabled via a #define statement. If macro is used for
  * debug-messages, the message are automatically disabled.
+ * The message is copied to the log ring buffer and transmitted via DMA in the
+ * background, so this function never blocks. If the ring buffer is full, the
+ * message is dropped and counted.
  *
  * @return nothing
  *******************************************************************************/
 void system_doNotUse_debugMessage(uint8_t* text, uint32_t size) {
-  char buffer[12] = "[     .   ] ";
+  char header[12] = "[     .   ] ";
   uint32_t time = HAL_GetTick();
-  buffer[9] = ((time % 10) / 1) + '0';
-  buffer[8] = ((time % 100) / 10) + '0';
-  buffer[7] = ((time % 1000) / 100) + '0';
-  buffer[5] = ((time % 10000) / 1000) + '0';
-  buffer[4] = ((time % 100000) / 10000) + '0';
-  buffer[3] = ((time % 1000000) / 100000) + '0';
-  buffer[2] = ((time % 10000000) / 1000000) + '0';
-  buffer[1] = ((time % 100000000) / 10000000) + '0';
-
-  HAL_UART_Transmit(&huart1, (uint8_t*)buffer, 12, 10);
-  HAL_UART_Transmit(&huart1, text, size, 10);
-  HAL_UART_Transmit(&huart1, (uint8_t*)"\n\r", 2, 10);
+  uint32_t primask, used, pos;
+  header[9] = ((time % 10) / 1) + '0';
+  header[8] = ((time % 100) / 10) + '0';
+  header[7] = ((time % 1000) / 100) + '0';
+  header[5] = ((time % 10000) / 1000) + '0';
+  header[4] = ((time % 100000) / 10000) + '0';
+  header[3] = ((time % 1000000) / 100000) + '0';
+  header[2] = ((time % 10000000) / 1000000) + '0';
+  header[1] = ((time % 100000000) / 10000000) + '0';
+
+  //Skip terminating zero of string literals
+  if(size > 0 && text[size - 1] == '\0') {
+    size--;
+  }
+
+  //Messages are also written from interrupts, reserve space atomically
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  used = (logWrite + LOG_BUFFER_SIZE - logRead) % LOG_BUFFER_SIZE;
+  if(used + sizeof(header) + size + 2 >= LOG_BUFFER_SIZE) {
+    logDrops++;
+    __set_PRIMASK(primask);
+    return;
+  }
+
+  pos = logWrite;
+  pos = system_writeLog(pos, (uint8_t*)header, sizeof(header));
+  pos = system_writeLog(pos, text, size);
+  pos = system_writeLog(pos, (uint8_t*)"\n\r", 2);
+  logWrite = pos;
+
+  system_startLogTransfer();
+  __set_PRIMASK(primask);
+}
+
+
+/*******************************************************************************
+ * Copies data to the log ring buffer.
+ *
+ * @param pos Position in ring buffer
+ * @param data The data
+ * @param size Number of bytes
+ * @return the position after the data
+ *******************************************************************************/
+static inline uint32_t system_writeLog(uint32_t pos, uint8_t* data, uint32_t size) {
+  for(uint32_t i = 0; i < size; i++) {
+    logBuffer[pos] = data[i];
+    pos = (pos + 1) % LOG_BUFFER_SIZE;
+  }
+  return pos;
+}
+
+
+/*******************************************************************************
+ * Starts the DMA transfer of the pending log data, if the UART is idle. The
+ * transfer ends at the end of the ring buffer, the rest follows with the next
+ * transfer. Must be called with interrupts disabled or from the UART interrupt.
+ *
+ * @return nothing
+ *******************************************************************************/
+static void system_startLogTransfer(void) {
+  uint32_t length;
+
+  if(!logReady || logTxLength != 0 || logRead == logWrite) {
+    return;
+  }
+
+  if(logWrite > logRead) {
+    length = logWrite - logRead;
+  } else {
+    length = LOG_BUFFER_SIZE - logRead;
+  }
+
+  logTxLength = length;
+  if(HAL_UART_Transmit_DMA(&huart1, &logBuffer[logRead], length) != HAL_OK) {
+    logTxLength = 0;
+  }
+}
+
+
+/*******************************************************************************
+ * Transmits the pending log data by polling (blocking). Used before a reset,
+ * where the interrupts might not be served anymore.
+ *
+ * @return nothing
+ *******************************************************************************/
+void system_flushDebug(void) {
+  if(!logReady) {
+    return;
+  }
+  for(uint32_t i = 0; i < LOG_FLUSH_LOOPS && logTxLength != 0; i++) {
+    HAL_DMA_IRQHandler(&hdma2_7);
+    HAL_UART_IRQHandler(&huart1);
+#ifdef ENABLE_WATCHDOG
+    HAL_IWDG_Refresh(&hiwdg);
+#endif
+  }
+}
+
+
+/*******************************************************************************
+ * Returns the number of debug messages, which were dropped because the log
+ * ring buffer was full.
+ *
+ * @return dropped messages
+ *******************************************************************************/
+uint32_t system_getDebugDrops(void) {
+  return logDrops;
+}
+
+
+/*******************************************************************************
+ * Log transfer finished, continue with the remaining data.
+ *
+ * @return nothing
+ *******************************************************************************/
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+  logRead = (logRead + logTxLength) % LOG_BUFFER_SIZE;
+  logTxLength = 0;
+  system_startLogTransfer();
+}
+
+
+/*******************************************************************************
+ * Log transfer failed, discard the data of the transfer.
+ *
+ * @return nothing
+ *******************************************************************************/
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+  HAL_UART_TxCpltCallback(huart);
+}
+
+
+/*******************************************************************************
+ * Interrupts of the debug-UART and its DMA
+ *
+ * @return nothing
+ *******************************************************************************/
+void DMA2_Stream7_IRQHandler(void) {
+  HAL_DMA_IRQHandler(&hdma2_7);
+}
+
+void USART1_IRQHandler(void) {
+  HAL_UART_IRQHandler(&huart1);
+}
+
+
+/*******************************************************************************
+ * Prints a debug message followed by a decimal value to debug-UART.
+ * Do not use this function directly. Instead use the macro system_debugValue.
+ *
+ * @return nothing
+ *******************************************************************************/
+void system_doNotUse_debugValue(uint8_t* text, uint32_t size, uint32_t value) {
+  uint8_t buffer[DEBUG_VALUE_BUFFER];
+  uint8_t digits[10];
+  uint32_t pos = 0, numDigits = 0;
+
+  //Text without terminating zero
+  for(uint32_t i = 0; i + 1 < size && pos < sizeof(buffer) - sizeof(digits); i++) {
+    buffer[pos++] = text[i];
+  }
+
+  //Decimal value
+  do {
+    digits[numDigits++] = (value % 10) + '0';
+    value /= 10;
+  } while(value > 0);
+
+  while(numDigits > 0) {
+    buffer[pos++] = digits[--numDigits];
+  }
+
+  system_doNotUse_debugMessage(buffer, pos);
 }
 #endif
 
@@ -241,31 +562,31 @@ void system_systickHandler( void ) {
  *******************************************************************************/
 void NMI_Handler(void) {
   system_debugMessage(DEBUG_PREFIX "NMI interrupt");
-  NVIC_SystemReset();
+  system_reset();
   while(1);
 }
 
 void HardFault_Handler(void) {
   system_debugMessage(DEBUG_PREFIX "HardFault interrupt");
-  NVIC_SystemReset();
+  system_reset();
   while(1);
 }
 
 void MemManage_Handler(void) {
   system_debugMessage(DEBUG_PREFIX "MemManager interrupt");
-  NVIC_SystemReset();
+  system_reset();
   while(1);
 }
 
 void BusFault_Handler(void) {
   system_debugMessage(DEBUG_PREFIX "BusFault interrupt");
-  NVIC_SystemReset();
+  system_reset();
   while(1);
 }
 
 void UsageFault_Handler(void) {
   system_debugMessage(DEBUG_PREFIX "UsageFault interrupt");
-  NVIC_SystemReset();
+  system_reset();
   while(1);
 }
 
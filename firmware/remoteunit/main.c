@@ -6,77 +6,366 @@
 *******************************************************************************/
 
 /* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
 #include <stm32f4xx_hal.h>
 #include <board.h>
 #include <system.h>
 #include <remoteIO.h>
 #include <joystickunit.h>
+#include <scheduler.h>
+#include <ioExpander.h>
+#include <dac.h>
 
 
 /* Defines -------------------------------------------------------------------*/
 #define DEBUG_PREFIX        "Main - "
-#define MAX_CRITICAL_LOOPS  25
+#define MAX_CRITICAL_LOOPS  25    //Consecutive faulty frames until failover
+#define RECOVERY_FRAMES     3     //Valid frames until Joystickunit-Mode is entered
+
+//Job periods in scheduler ticks (see SCHEDULER_TICK_US)
+#define PERIOD_INPUTS       1     //Sampling of inputs
+#define PERIOD_LINK         1     //Link exchange with joystick-unit
+#define PERIOD_OUTPUTS      1     //Update of outputs
+#define PERIOD_SYSTEM       5     //Watchdog and debug-LED
+#define REPORT_PERIOD_MS    500   //Cycle-time report via debug-UART
+#define STATS_PERIOD_MS     1000  //Window of the statistics sent to joystick-unit
+
+//Index of the jobs in the job table
+#define JOB_INPUTS          0
+#define JOB_LINK            1
+#define JOB_OUTPUTS         2
+#define JOB_SYSTEM          3
+
+
+/* Typedefs ------------------------------------------------------------------*/
+//Boot phases, timestamps are taken at the end of each phase
+typedef enum {
+  BOOT_PASSTHROUGH = 0,   //Inputs are forwarded to the outputs
+  BOOT_DEBUG,             //Debug-UART initialized
+  BOOT_EXTERNAL,          //GPIO-expander initialized
+  BOOT_FINISHED,          //Link and scheduler initialized
+  BOOT_PHASES
+} Main_BootPhase_t;
+
+
+/* Prototypes ----------------------------------------------------------------*/
+static void main_inputsJob(void);
+static void main_linkJob(void);
+static void main_outputsJob(void);
+static void main_systemJob(void);
+static void main_failover(void);
+static void main_updateStats(void);
+static void main_bootTimestamp(Main_BootPhase_t phase);
+#ifdef USE_DEBUG_UART
+static void main_reportCycleTime(void);
+#endif
+
+
+/* Variables -----------------------------------------------------------------*/
+static RemoteIO_States_t inputs = {0};
+static RemoteIO_States_t outputs = {0};
+static Joystickunit_State_t joyState = JOY_STATE_NOT_AVAILABLE;
+static bool joystickMode = false;
+static bool newOutputs = false;
+static bool linkStarted = false;
+static bool failoverPending = false;
+static uint32_t errorCnt = 0;
+static uint32_t linkErrors = 0;
+static uint32_t validFrames = 0;
+static uint32_t lastValidFrame = 0;     //Cycle counter
+static uint32_t firstValidFrame = 0;    //Cycle counter
+static uint32_t failovers = 0;
+static uint32_t failoverTime = 0;       //us
+static uint32_t recoveryTime = 0;       //us
+static uint32_t cycleTime = 0;
+static uint32_t cpuLoad = 0;            //Per mille
+static uint32_t bootTimestamps[BOOT_PHASES] = {0};  //us since system_init()
+
+//Jobs of a tick are executed in this order (sample -> exchange -> output)
+static Scheduler_Job_t jobs[] = {
+    [JOB_INPUTS]  = {.function = main_inputsJob,  .period = PERIOD_INPUTS,  .offset = 0},
+    [JOB_LINK]    = {.function = main_linkJob,    .period = PERIOD_LINK,    .offset = 0},
+    [JOB_OUTPUTS] = {.function = main_outputsJob, .period = PERIOD_OUTPUTS, .offset = 0},
+    [JOB_SYSTEM]  = {.function = main_systemJob,  .period = PERIOD_SYSTEM,  .offset = 0}};
 
 
 /* Code ----------------------------------------------------------------------*/
 int main(void) {
-  RemoteIO_States_t inputs = {0};
-  RemoteIO_States_t outputs = {0};
-  Joystickunit_State_t joyState = JOY_STATE_NOT_AVAILABLE;
-  uint32_t errorCnt = 0;
-
   //Init system
   HAL_Init();
   system_setupClock();
-
-  //Init peripherals
   system_init();
+
+  //Start passthrough first, the inputs are forwarded during the remaining init
   remoteIO_init();
+  remoteIO_getStates(&inputs, REMOTEIO_INTEREST_DIGITAL_ALL);
+  remoteIO_setAnalogPassthrough(true);
+  remoteIO_setStates(&inputs);
+  main_bootTimestamp(BOOT_PASSTHROUGH);
+
+  //Init remaining peripherals
+  system_initDebug();
+  main_bootTimestamp(BOOT_DEBUG);
+  remoteIO_initExternal();
+  main_bootTimestamp(BOOT_EXTERNAL);
   joystickunit_init();
+  scheduler_init();
   system_watchdogHandler();
+  main_bootTimestamp(BOOT_FINISHED);
 
   system_debugMessage(DEBUG_PREFIX "Init finished");
+  system_debugValue(DEBUG_PREFIX "Core clock [MHz]: ", SystemCoreClock / 1000000);
+  system_debugValue(DEBUG_PREFIX "Boot: passthrough started [us]: ", bootTimestamps[BOOT_PASSTHROUGH]);
+  system_debugValue(DEBUG_PREFIX "Boot: debug-UART ready [us]: ", bootTimestamps[BOOT_DEBUG]);
+  system_debugValue(DEBUG_PREFIX "Boot: external GPIOs ready [us]: ", bootTimestamps[BOOT_EXTERNAL]);
+  system_debugValue(DEBUG_PREFIX "Boot: init finished [us]: ", bootTimestamps[BOOT_FINISHED]);
+  joystickunit_setStat(JOY_STAT_RESET_CAUSE, system_getResetCause());
+
+  scheduler_run(jobs, sizeof(jobs)/sizeof(jobs[0]));
+}
+
 
-  while (1) {
-    //Standalone-Mode (without joystick-unit)
-    do {
-      remoteIO_getStates(&inputs);
-      remoteIO_setStates(&inputs);
-      system_handler(JOY_STATE_NOT_AVAILABLE);
-    } while(HAL_GPIO_ReadPin(RJ12_CS_Port, RJ12_CS_Pin) == GPIO_PIN_RESET);
+/*******************************************************************************
+ * Stores the time since the cycle counter was started by system_init() (right
+ * after the clock setup) for a boot phase. The time before (startup code,
+ * bootloader and clock setup) is not included.
+ *
+ * @param phase The finished boot phase
+ * @return nothing
+ *******************************************************************************/
+static void main_bootTimestamp(Main_BootPhase_t phase) {
+  bootTimestamps[phase] = DWT->CYCCNT / (SystemCoreClock / 1000000);
+}
 
-    //Switch to Joystickunit-Mode
 
-    //Wait for the first communication to finish
-    joyState = joystickunit_communicate(&inputs, &outputs);
+/*******************************************************************************
+ * Job: Reads the inputs. In Joystickunit-Mode only the inputs needed by the
+ * joystick-unit are sampled. In Standalone-Mode the analog inputs are passed
+ * through by remoteIO, they are only sampled once the link is started.
+ *
+ * @return nothing
+ *******************************************************************************/
+static void main_inputsJob(void) {
+  if(joystickMode) {
+    remoteIO_getStates(&inputs, joystickunit_getInterest());
+  } else if(linkStarted) {
+    remoteIO_getStates(&inputs, REMOTEIO_INTEREST_ALL);
+  } else {
+    remoteIO_getStates(&inputs, REMOTEIO_INTEREST_DIGITAL_ALL);
+  }
+}
 
-    while(1) {
-      remoteIO_getStates(&inputs);
 
-      joyState = joystickunit_communicate(&inputs, &outputs);
+/*******************************************************************************
+ * Job: Exchanges data with the joystick-unit. The link is started as soon as
+ * the joystick-unit starts the communication, Joystickunit-Mode is entered
+ * after RECOVERY_FRAMES valid frames. If the joystick-unit disappears, the
+ * outputs fall back to passthrough (Standalone-Mode) without a reset.
+ *
+ * @return nothing
+ *******************************************************************************/
+static void main_linkJob(void) {
+  //Wait for joystick-unit (drives CS high, low without joystick-unit)
+  if(!linkStarted) {
+    if(HAL_GPIO_ReadPin(RJ12_CS_Port, RJ12_CS_Pin) == GPIO_PIN_RESET) {
+      return;
+    }
+    linkStarted = true;
+    validFrames = 0;
+  }
 
+  switch(joystickunit_communicate(&inputs, &outputs)) {
+    case JOY_STATE_BUSY:
+      break;
+    case JOY_STATE_OK:
+      errorCnt = 0;
+      lastValidFrame = DWT->CYCCNT;
+      if(joystickMode) {
+        newOutputs = true;
+        joyState = JOY_STATE_OK;
+        break;
+      }
+      if(validFrames == 0) {
+        firstValidFrame = DWT->CYCCNT;
+      }
+      if(++validFrames >= RECOVERY_FRAMES) {
+        joystickMode = true;
+        newOutputs = true;
+        joyState = JOY_STATE_OK;
+      }
+      break;
+    case JOY_STATE_ERROR:
+      //Keep old states in case of error
+      errorCnt++;
+      linkErrors++;
+      validFrames = 0;
+      system_debugMessage(DEBUG_PREFIX "Communication error");
+      if(joystickMode) {
+        joyState = JOY_STATE_ERROR;
+      }
       if(errorCnt > MAX_CRITICAL_LOOPS) {
-        joyState = JOY_STATE_NOT_AVAILABLE;
+        main_failover();
       }
-
-      switch(joyState) {
-        case JOY_STATE_OK:
-          remoteIO_setStates(&outputs);
-          errorCnt=0;
-          break;
-        case JOY_STATE_ERROR:
-          //Keep old states in case of error
-          errorCnt++;
-          system_debugMessage(DEBUG_PREFIX "Communication error");
-          break;
-        case JOY_STATE_NOT_AVAILABLE:
-        default:
-          system_debugMessage(DEBUG_PREFIX "Joystick not available");
-          NVIC_SystemReset();
-          break;
+      break;
+    case JOY_STATE_UPDATE:
+      //Firmware update in progress, outputs fall back to passthrough
+      errorCnt = 0;
+      validFrames = 0;
+      if(joystickMode) {
+        main_failover();
       }
+      break;
+    case JOY_STATE_NOT_AVAILABLE:
+    default:
+      system_debugMessage(DEBUG_PREFIX "Joystick not available");
+      linkStarted = false;
+      main_failover();
+      break;
+  }
+}
+
 
-      system_handler(joyState);
+/*******************************************************************************
+ * Falls back to passthrough of the inputs. The inputs are sampled completely,
+ * so the outputs job of the same tick applies the passthrough.
+ *
+ * @return nothing
+ *******************************************************************************/
+static void main_failover(void) {
+  errorCnt = 0;
+  validFrames = 0;
+  joyState = JOY_STATE_NOT_AVAILABLE;
+
+  if(joystickMode) {
+    joystickMode = false;
+    failoverPending = true;
+    failovers++;
+    remoteIO_getStates(&inputs, REMOTEIO_INTEREST_ALL);
+  }
+}
+
+
+/*******************************************************************************
+ * Job: Writes the outputs. In Standalone-Mode the inputs are passed through
+ * (the analog inputs by the timer interrupt of remoteIO), in Joystickunit-Mode
+ * the outputs are written after each valid frame. The
+ * time from the last valid frame until the passthrough is applied (failover)
+ * and from the first valid frame until the outputs of the joystick-unit are
+ * applied (recovery) are measured.
+ *
+ * @return nothing
+ *******************************************************************************/
+static void main_outputsJob(void) {
+  uint32_t cyclesPerUs = SystemCoreClock / 1000000;
+
+  if(!joystickMode) {
+    remoteIO_setAnalogPassthrough(true);
+    remoteIO_setStates(&inputs);
+    if(failoverPending) {
+      failoverPending = false;
+      failoverTime = (DWT->CYCCNT - lastValidFrame) / cyclesPerUs;
+      joystickunit_setStat(JOY_STAT_FAILOVERS, failovers);
+      joystickunit_setStat(JOY_STAT_FAILOVER_TIME, failoverTime);
+      system_debugValue(DEBUG_PREFIX "Failover to passthrough [us]: ", failoverTime);
     }
+  } else if(newOutputs) {
+    newOutputs = false;
+    remoteIO_setAnalogPassthrough(false);
+    remoteIO_setStates(&outputs);
+    if(validFrames > 0) {
+      validFrames = 0;
+      recoveryTime = (DWT->CYCCNT - firstValidFrame) / cyclesPerUs;
+      joystickunit_setStat(JOY_STAT_RECOVERY_TIME, recoveryTime);
+      system_debugValue(DEBUG_PREFIX "Joystickunit-Mode entered [us]: ", recoveryTime);
+    }
+  }
+}
+
+
+/*******************************************************************************
+ * Job: Housekeeping (watchdog, debug-LED, statistics and cycle-time report).
+ *
+ * @return nothing
+ *******************************************************************************/
+static void main_systemJob(void) {
+  system_handler(joyState);
+  main_updateStats();
+#ifdef USE_DEBUG_UART
+  main_reportCycleTime();
+#endif
+}
+
+
+/*******************************************************************************
+ * Updates the statistics sent to the joystick-unit. The execution times are the
+ * longest ones within STATS_PERIOD_MS.
+ *
+ * @return nothing
+ *******************************************************************************/
+static void main_updateStats(void) {
+  static uint32_t lastStats = 0;
+
+  if(HAL_GetTick() - lastStats < STATS_PERIOD_MS) {
+    return;
+  }
+  lastStats = HAL_GetTick();
+
+  cycleTime = jobs[JOB_INPUTS].maxExecTime + jobs[JOB_LINK].maxExecTime +
+      jobs[JOB_OUTPUTS].maxExecTime;
+
+  joystickunit_setStat(JOY_STAT_CYCLE_TIME, cycleTime);
+  joystickunit_setStat(JOY_STAT_INPUTS_TIME, jobs[JOB_INPUTS].maxExecTime);
+  joystickunit_setStat(JOY_STAT_LINK_TIME, jobs[JOB_LINK].maxExecTime);
+  joystickunit_setStat(JOY_STAT_OUTPUTS_TIME, jobs[JOB_OUTPUTS].maxExecTime);
+  joystickunit_setStat(JOY_STAT_I2C_TIME, ioExpander_getMaxTransferTime());
+  joystickunit_setStat(JOY_STAT_DAC_TIME, dac_getMaxBurstTime());
+  joystickunit_setStat(JOY_STAT_LINK_ERRORS, linkErrors);
+  joystickunit_setStat(JOY_STAT_I2C_ERRORS, ioExpander_getErrors());
+  joystickunit_setStat(JOY_STAT_MISSED_TICKS, scheduler_getMissedTicks());
+  cpuLoad = scheduler_getLoad();
+  joystickunit_setStat(JOY_STAT_CPU_LOAD, cpuLoad);
+
+  for(uint32_t i = 0; i < sizeof(jobs)/sizeof(jobs[0]); i++) {
+    jobs[i].maxExecTime = 0;
+  }
+}
+
+
+#ifdef USE_DEBUG_UART
+/*******************************************************************************
+ * Reports the cycle time (longest execution of sample, exchange and output
+ * within the statistics window), the CPU load, the missed ticks, the dropped
+ * debug messages and the saved bus transactions of the outputs one after
+ * another via debug-UART.
+ *
+ * @return nothing
+ *******************************************************************************/
+static void main_reportCycleTime(void) {
+  static uint32_t lastReport = 0;
+  static uint32_t report = 0;
+
+  if(HAL_GetTick() - lastReport < REPORT_PERIOD_MS) {
+    return;
+  }
+  lastReport = HAL_GetTick();
+
+  switch(report) {
+    case 0:
+      system_debugValue(DEBUG_PREFIX "Cycle time [us]: ", cycleTime);
+      break;
+    case 1:
+      system_debugValue(DEBUG_PREFIX "CPU load [per mille]: ", cpuLoad);
+      break;
+    case 2:
+      system_debugValue(DEBUG_PREFIX "Missed ticks: ", scheduler_getMissedTicks());
+      break;
+    case 3:
+      system_debugValue(DEBUG_PREFIX "Dropped messages: ", system_getDebugDrops());
+      break;
+    default:
+      system_debugValue(DEBUG_PREFIX "Saved bus transactions: ", remoteIO_getSavedTransactions());
+      break;
   }
+  report = (report + 1) % 5;
 }
+#endif